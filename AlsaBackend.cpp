@@ -0,0 +1,181 @@
+#include "AlsaBackend.h"
+
+#ifdef ALSABACKEND_AVAILABLE
+#include "Mixer.h"
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <poll.h>
+#include <cerrno>
+#include <iostream>
+
+AlsaBackend::AlsaBackend(const std::string& pcmName, int periodCount)
+    : device(pcmName), periods(periodCount < 2 ? 2 : periodCount)
+{
+}
+
+bool AlsaBackend::open(Mixer& source)
+{
+    mixer = &source;
+    xrunCount = 0;
+    delayFrames = 0;
+
+    int err = snd_pcm_open(&pcm, device.c_str(), SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+    if (err < 0) {
+        std::cout << "ALSA: cannot open \"" << device << "\": " << snd_strerror(err) << std::endl;
+        pcm = nullptr;
+        return false;
+    }
+
+    // periods of one mixer block, so every write is one render
+    snd_pcm_hw_params_t* hw;
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_uframes_t periodSize = source.blockFrames();
+    unsigned int count = (unsigned int)periods;
+
+    if ((err = snd_pcm_hw_params_any(pcm, hw)) < 0 ||
+        (err = snd_pcm_hw_params_set_rate_resample(pcm, hw, 1)) < 0 ||
+        (err = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0 ||
+        (err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_FLOAT)) < 0 ||
+        (err = snd_pcm_hw_params_set_channels(pcm, hw, Mixer::CHANNELS)) < 0 ||
+        (err = snd_pcm_hw_params_set_rate(pcm, hw, Mixer::SAMPLE_RATE, 0)) < 0 ||
+        (err = snd_pcm_hw_params_set_period_size_near(pcm, hw, &periodSize, nullptr)) < 0 ||
+        (err = snd_pcm_hw_params_set_periods_near(pcm, hw, &count, nullptr)) < 0 ||
+        (err = snd_pcm_hw_params(pcm, hw)) < 0) {
+        std::cout << "ALSA: \"" << device << "\" does not take 44.1 kHz stereo float32: " << snd_strerror(err) << std::endl;
+        close();
+        return false;
+    }
+
+    snd_pcm_uframes_t bufferSize = 0;
+    snd_pcm_hw_params_get_buffer_size(hw, &bufferSize);
+    period = (uint32_t)periodSize;
+    buffer = (uint32_t)bufferSize;
+
+    // start once as many whole blocks as fit are queued, and wake the
+    // thread whenever another block fits
+    uint32_t blockFrames = source.blockFrames();
+    snd_pcm_uframes_t startAt = bufferSize / blockFrames * blockFrames;
+
+    snd_pcm_sw_params_t* sw;
+    snd_pcm_sw_params_alloca(&sw);
+    if ((err = snd_pcm_sw_params_current(pcm, sw)) < 0 ||
+        (err = snd_pcm_sw_params_set_start_threshold(pcm, sw, startAt ? startAt : blockFrames)) < 0 ||
+        (err = snd_pcm_sw_params_set_avail_min(pcm, sw, blockFrames)) < 0 ||
+        (err = snd_pcm_sw_params(pcm, sw)) < 0 ||
+        (err = snd_pcm_prepare(pcm)) < 0) {
+        std::cout << "ALSA: cannot start \"" << device << "\": " << snd_strerror(err) << std::endl;
+        close();
+        return false;
+    }
+
+    std::cout << "ALSA: \"" << device << "\", " << buffer / (period ? period : 1) << " periods of " << period
+        << " frames, " << buffer * 1000.0 / Mixer::SAMPLE_RATE << " ms buffered" << std::endl;
+
+    block.assign(blockFrames * Mixer::CHANNELS, 0.0f);
+    stopping = false;
+    thread = std::thread(&AlsaBackend::run, this);
+
+    // real-time priority when allowed, normal otherwise
+    sched_param param{};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+    pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+    return true;
+}
+
+void AlsaBackend::close()
+{
+    if (thread.joinable()) {
+        stopping = true;
+        thread.join();
+    }
+
+    if (pcm) {
+        snd_pcm_drop(pcm);
+        snd_pcm_close(pcm);
+    }
+
+    pcm = nullptr;
+    mixer = nullptr;
+}
+
+// sleeps until the device has room, or 100 ms at most. Plugin PCMs such as
+// dmix and pulse wake through descriptors of their own, whose raw events
+// only ALSA can translate into POLLOUT; an error is left for the next
+// avail or write to report
+static void waitForRoom(snd_pcm_t* pcm, std::vector<pollfd>& fds)
+{
+    while (true)
+    {
+        int ready = poll(fds.data(), (nfds_t)fds.size(), 100);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return;
+
+        unsigned short revents = 0;
+        if (snd_pcm_poll_descriptors_revents(pcm, fds.data(), (unsigned int)fds.size(), &revents) < 0) return;
+        if (revents & (POLLOUT | POLLERR | POLLNVAL)) return;
+    }
+}
+
+void AlsaBackend::run()
+{
+    std::vector<pollfd> fds((size_t)snd_pcm_poll_descriptors_count(pcm));
+    snd_pcm_poll_descriptors(pcm, fds.data(), (unsigned int)fds.size());
+
+    const uint32_t frames = mixer->blockFrames();
+    const float* next = nullptr;
+    uint32_t pending = 0;
+
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            if (!recover((int)avail)) break;
+            continue;
+        }
+
+        // render only once the block fits, so it is as fresh as it can be
+        if (pending == 0) {
+            if ((snd_pcm_uframes_t)avail < frames) {
+                waitForRoom(pcm, fds);
+                continue;
+            }
+
+            mixer->render(block.data(), frames);
+            next = block.data();
+            pending = frames;
+        }
+
+        snd_pcm_sframes_t written = snd_pcm_writei(pcm, next, pending);
+        if (written == -EAGAIN) {
+            waitForRoom(pcm, fds);
+            continue;
+        }
+        if (written < 0) {
+            if (!recover((int)written)) break;
+            continue;
+        }
+
+        next += written * Mixer::CHANNELS;
+        pending -= (uint32_t)written;
+
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_delay(pcm, &delay) == 0)
+            delayFrames.store(delay > 0 ? (uint64_t)delay : 0, std::memory_order_relaxed);
+    }
+}
+
+bool AlsaBackend::recover(int err)
+{
+    // an underrun or a suspend: prepare again and carry on, the ring refills
+    // and restarts at the start threshold
+    if (err == -EPIPE) xrunCount++;
+
+    err = snd_pcm_recover(pcm, err, 1);
+    if (err < 0) {
+        std::cout << "ALSA: output stopped: " << snd_strerror(err) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include "AudioBackend.h"
+
+// built wherever the ALSA headers are installed; link with -lasound
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<alsa/asoundlib.h>)
+#define ALSABACKEND_AVAILABLE
+#endif
+#endif
+
+typedef struct _snd_pcm snd_pcm_t;
+
+// Plays the mixer output through an ALSA PCM as interleaved float32. A
+// dedicated thread renders a block at a time and writes it without
+// blocking, sleeping in poll() until the device has room. The PCM is set up
+// for periods of the mixer's block size, `periods` of them in the ring;
+// ALSA may round both, and what it settled on is reported. Underruns are
+// recovered from on the spot and counted as xruns.
+class AlsaBackend : public AudioBackend
+{
+public:
+    // any PCM name: "default", "hw:0,0", or "null" and
+    // "file:FILE=out.raw,FORMAT=raw" to run without sound hardware
+    explicit AlsaBackend(const std::string& pcmName = "default", int periodCount = 4);
+
+    bool open(Mixer& mixer) override;
+    void close() override;
+    const char* name() const override { return "ALSA"; }
+    unsigned long long xruns() const override { return xrunCount; }
+    uint64_t queuedFrames() const override { return delayFrames; }
+
+    // what the device accepted
+    uint32_t periodFrames() const { return period; }
+    uint32_t bufferFrames() const { return buffer; }
+
+private:
+    void run();
+    bool recover(int err);
+
+    std::string device;
+    int periods;
+
+    snd_pcm_t* pcm = nullptr;
+    Mixer* mixer = nullptr;
+    uint32_t period = 0;
+    uint32_t buffer = 0;
+    std::vector<float> block;
+
+    std::thread thread;
+    std::atomic<bool> stopping{ false };
+    std::atomic<unsigned long long> xrunCount{ 0 };
+    std::atomic<uint64_t> delayFrames{ 0 };
+};
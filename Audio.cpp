@@ -1,143 +1,1442 @@
 #include "Audio.h"
+#include "WavParser.h"
+#include "SampleCodec.h"
+#include "Resampler.h"
+#include "SampleAnalysis.h"
+#include "OfflineBackend.h"
+#include "RealtimeGuard.h"
+#include "AlsaBackend.h"
 #include <fstream>
-#include <windows.h>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <algorithm>
+#include <cmath>
 
-#pragma comment(lib, "xaudio2.lib")
+#ifdef _WIN32
+#include "XAudio2Backend.h"
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
 
-IXAudio2* AudioEngine::xaudio = nullptr;
-IXAudio2MasteringVoice* AudioEngine::masterVoice = nullptr;
-std::vector<AudioEngine::Voice> AudioEngine::activeVoices;
+Mixer AudioEngine::mixer;
+std::unique_ptr<AudioBackend> AudioEngine::backend;
+OfflineBackend* AudioEngine::offline = nullptr;
+VoicePool<AudioEngine::Voice, Mixer::MAX_VOICES> AudioEngine::activeVoices;
+SpscQueue<AudioEngine::Command, AudioEngine::COMMAND_QUEUE_SIZE> AudioEngine::commands;
+SpscQueue<AudioEngine::Voice, AudioEngine::COMMAND_QUEUE_SIZE * 2> AudioEngine::retiredVoices;
+int AudioEngine::notesInFlight = 0;
+std::atomic<uint32_t> AudioEngine::stopAllGeneration{ 0 };
+uint32_t AudioEngine::stoppedGeneration = 0;
+CommandStats AudioEngine::queueStats;
+std::array<AudioEngine::Command, AudioEngine::COMMAND_QUEUE_SIZE * 2> AudioEngine::scheduled;
+int AudioEngine::scheduledCount = 0;
+uint32_t AudioEngine::scheduleOrder = 0;
+std::atomic<uint32_t> AudioEngine::stampSequence{ 0 };
+std::atomic<uint64_t> AudioEngine::stampFrame{ 0 };
+std::atomic<int64_t> AudioEngine::stampNanos{ 0 };
+std::atomic<int> AudioEngine::peakVoices{ 0 };
+std::atomic<unsigned long long> AudioEngine::voiceBlocks{ 0 };
+std::atomic<unsigned long long> AudioEngine::voiceBlockSum{ 0 };
+std::atomic<unsigned long long> AudioEngine::takeovers{ 0 };
+std::atomic<unsigned long long> AudioEngine::steals{ 0 };
+std::atomic<unsigned long long> AudioEngine::cuts{ 0 };
+std::atomic<unsigned long long> AudioEngine::slides{ 0 };
+std::atomic<unsigned long long> AudioEngine::endedVoices{ 0 };
+std::atomic<unsigned long long> AudioEngine::lifetimeFrames{ 0 };
+std::atomic<unsigned long long> AudioEngine::longestLifetime{ 0 };
+KarplusStrong AudioEngine::synthVoices[Mixer::MAX_VOICES];
+uint32_t AudioEngine::plucks = 0;
+StringBank AudioEngine::stringBank;
+Convolver AudioEngine::convolver;
 
 const std::array<std::string, 6> AudioEngine::stringNames = {
     "E", "A", "D", "G", "B", "Eh"
 };
 
 AudioEngine::Sound AudioEngine::cachedSounds[STRINGS][FRETS];
+SampleBank AudioEngine::bank;
+SampleStreamer AudioEngine::streamer;
+AudioConfig AudioEngine::config;
+
+std::mutex AudioEngine::residencyMutex;
+std::condition_variable AudioEngine::residencyChanged;
+std::list<int> AudioEngine::lru;
+size_t AudioEngine::lruBytes = 0;
+ResidencyStats AudioEngine::stats;
+TailStats AudioEngine::trimStats;
+
+std::thread AudioEngine::prefetchThread;
+std::condition_variable AudioEngine::prefetchWake;
+std::array<int, AudioEngine::STRINGS * AudioEngine::FRETS> AudioEngine::prefetchQueue;
+int AudioEngine::prefetchHead = 0;
+int AudioEngine::prefetchCount = 0;
+bool AudioEngine::prefetchStop = false;
+std::array<int, AudioEngine::STRINGS> AudioEngine::chordShape = { -1, -1, -1, -1, -1, -1 };
+
+constexpr const char* AudioEngine::BANK_PATH;
+constexpr int AudioEngine::COMMAND_QUEUE_SIZE;
+
+static const uint32_t ENVELOPE_WINDOW_MS = 10;
+static const uint32_t TAIL_FADE_MS = 5;
+
+static size_t residentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return pmc.WorkingSetSize;
+#else
+    // the second field of statm is the resident set, in pages
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, residentPages = 0;
+    if (!(statm >> pages >> residentPages)) return 0;
+    return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static Mixer::Encoding encodingOf(const SampleBank::Format& format)
+{
+    if (format.formatTag == WavInfo::FORMAT_IEEE_FLOAT) return Mixer::Encoding::Float32;
+    if (format.bitsPerSample == 24) return Mixer::Encoding::Int24;
+    if (format.bitsPerSample == 32) return Mixer::Encoding::Int32;
+    return Mixer::Encoding::Int16;
+}
+
+// runs fn(0..count-1) on up to `threads` workers, each pulling the next index
+static void parallelFor(int count, int threads, const std::function<void(int)>& fn)
+{
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+    if (threads > count) threads = count;
+
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++)
+            fn(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(worker);
+
+    worker();
+
+    for (auto& t : pool)
+        t.join();
+}
+
+std::string AudioEngine::samplePath(int stringIndex, int fretIndex)
+{
+    return "res/audio/" + stringNames[stringIndex] + "/" + std::to_string(fretIndex) + ".wav";
+}
+
+const char* AudioEngine::loadWav(const std::string& path, Sound& out)
+{
+    RealtimeGuard::blocking("WAV file read");
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) return "missing WAV file";
+
+    std::streamoff length = f.tellg();
+    if (length < 0) return "unreadable WAV file";
+    out.samples.resize((size_t)length);
+    f.seekg(0);
+    f.read((char*)out.samples.data(), length);
+    if (!f) return "unreadable WAV file";
+
+    WavInfo info;
+    WavError error = parseWav(out.samples.data(), out.samples.size(), info);
+    if (error != WavError::None) return wavErrorString(error);
 
-bool AudioEngine::loadWav(const std::string& path, Sound& out)
+    SampleBank::Format format{};
+    format.formatTag = info.formatTag;
+    format.channels = info.channels;
+    format.bitsPerSample = info.bitsPerSample;
+    format.blockAlign = info.blockAlign;
+    format.sampleRate = info.sampleRate;
+    format.avgBytesPerSec = info.avgBytesPerSec;
+
+    // the sample data stays in place inside the file image
+    out.format = format;
+    out.data = info.data;
+    out.size = (uint32_t)info.dataSize;
+
+    return nullptr;
+}
+
+bool AudioEngine::init(const AudioConfig& cfg)
 {
-    std::ifstream f(path, std::ios::binary);
-    if (!f) return false;
+    config = cfg;
+    config.maxVoices = std::max(1, std::min(config.maxVoices, Mixer::MAX_VOICES));
+    config.blockFrames = std::max(16, std::min(config.blockFrames, (int)Mixer::MAX_BLOCK_FRAMES));
+    config.outputBuffers = std::max(2, std::min(config.outputBuffers, 16));
+
+    queueStats = CommandStats();
+    trimStats = TailStats();
+    scheduledCount = 0;
+    scheduleOrder = 0;
+    stoppedGeneration = stopAllGeneration.load();
+    peakVoices = 0;
+    voiceBlocks = voiceBlockSum = 0;
+    takeovers = steals = cuts = slides = 0;
+    endedVoices = lifetimeFrames = longestLifetime = 0;
+    plucks = 0;
+    mixer.reset();
+    mixer.setBlockFrames((uint32_t)config.blockFrames);
+    mixer.setBlockCallback(processCommands, nullptr);
+    mixer.setEndCallback(voiceEnded, nullptr);
+
+    // the bank never ends, so it plays from the first block to shutdown
+    if (config.notes == NoteSource::StringBank) {
+        stringBank.reset(config.strings, StringBank::bridgeCoupling(config.bridgeCoupling));
+        Mixer::Source source;
+        source.generator = &stringBank;
+        mixer.play(source, 1.0f);
+    }
+
+    // the tail runs inline offline, where blocks come faster than real time
+    mixer.setEffect(nullptr);
+    if (!config.impulseResponsePath.empty()) {
+        const char* error = convolver.loadWav(config.impulseResponsePath);
+        if (error) {
+            std::cout << "Impulse response " << config.impulseResponsePath << " not loaded: " << error << std::endl;
+            config.impulseResponsePath.clear();
+        } else {
+            float mix = std::min(std::max(config.impulseResponseMix, 0.0f), 1.0f);
+            convolver.setMix(1.0f - mix, mix);
+            convolver.start(config.output != AudioOutput::Offline);
+            mixer.setEffect(&convolver);
+            std::cout << "Output convolved with " << config.impulseResponsePath << " ("
+                << (double)convolver.length() / Mixer::SAMPLE_RATE << " s)" << std::endl;
+        }
+    }
+
+    if (config.output == AudioOutput::Offline) {
+        offline = new OfflineBackend(config.offlineWavPath);
+        backend.reset(offline);
+    } else {
+#ifdef _WIN32
+        backend.reset(new XAudio2Backend(config.outputBuffers));
+#elif defined(ALSABACKEND_AVAILABLE)
+        backend.reset(new AlsaBackend(config.alsaDevice, config.outputBuffers));
+#endif
+    }
 
-    char id[4];
-    uint32_t size;
+    if (!backend || !backend->open(mixer)) {
+        std::cout << "No audio output available" << std::endl;
+        backend.reset();
+        offline = nullptr;
+        convolver.stop();
+        mixer.setEffect(nullptr);
+        return false;
+    }
+
+    // nothing to load, every note is plucked as it is played
+    if (config.notes != NoteSource::Samples) {
+        std::cout << "Audio notes synthesised from "
+            << (config.notes == NoteSource::StringBank ? "a coupled six-string bank" : "string models")
+            << ", no samples loaded" << std::endl;
+        return true;
+    }
 
-    f.read(id, 4);
-    f.read((char*)&size, 4);
-    f.read(id, 4);
+    auto start = std::chrono::steady_clock::now();
+    size_t residentBefore = residentBytes();
 
-    while (true) {
-        f.read(id, 4);
-        f.read((char*)&size, 4);
-        if (!memcmp(id, "fmt ", 4)) break;
-        f.seekg(size, std::ios::cur);
+    bool fromBank = bank.open(BANK_PATH, !config.streamFromDisk);
+    int loaded = 0;
+
+    if (config.streamFromDisk) {
+        if (fromBank)
+            streamer.start(bank, Mixer::MAX_VOICES);
+        else
+            std::cout << "Disk streaming needs " << BANK_PATH << ", loading loose WAVs instead" << std::endl;
     }
 
-    f.read((char*)&out.wfx, size);
+    // synthesised frets are always produced on demand in the background
+    prefetchStop = false;
+    prefetchHead = prefetchCount = 0;
+    prefetchThread = std::thread(prefetchLoop);
 
-    while (true) {
-        f.read(id, 4);
-        f.read((char*)&size, 4);
-        if (!memcmp(id, "data", 4)) break;
-        f.seekg(size, std::ios::cur);
+    if (config.lazyLoading) {
+        // open strings are the likeliest first notes
+        for (int s = 0; s < STRINGS; s++)
+            requestPrefetch(s, 0);
+    } else {
+        loaded = loadSamples(config.loaderThreads, fromBank);
     }
 
-    out.samples.resize(size);
-    f.read((char*)out.samples.data(), size);
-    out.loaded = true;
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    size_t residentAfter = residentBytes();
+
+    // signed, the process can shrink while loading, e.g. on a second init
+    double residentDelta = ((double)residentAfter - (double)residentBefore) / (1024.0 * 1024.0);
+
+    std::cout << "Audio samples loaded (" << loaded << " of " << STRINGS * FRETS << " frets) from "
+        << (fromBank ? BANK_PATH : "res/audio/*.wav")
+        << " in " << ms << " ms, resident memory " << (residentDelta < 0.0 ? "" : "+")
+        << residentDelta << " MB ("
+        << residentAfter / (1024.0 * 1024.0) << " MB total)";
+    if (config.trimTails && !config.lazyLoading)
+        std::cout << ", " << trimStats.bytesDropped / (1024.0 * 1024.0) << " MB of silent tails trimmed";
+    std::cout << std::endl;
 
     return true;
 }
 
-bool AudioEngine::init()
+int AudioEngine::loadSamples(int threads, bool fromBank)
 {
-    if (FAILED(XAudio2Create(&xaudio, 0)))
-        return false;
+    const int count = STRINGS * FRETS;
+    std::vector<const char*> errors(count, nullptr);
 
-    if (FAILED(xaudio->CreateMasteringVoice(&masterVoice)))
-        return false;
+    parallelFor(count, threads, [&](int i) {
+        int s = i / FRETS;
+        int f = i % FRETS;
+        Sound& snd = cachedSounds[s][f];
+        if (!isAnchor(f)) return;
+
+        const char* error = fromBank ? loadFromBank(s, f, snd) : loadLooseWav(s, f, snd);
+        if (!error) error = validateSound(snd);
+        if (!error) trimTail(snd);
+        if (!error) preparePlanar(snd);
+
+        // what plays stays faulted in, so the first note on a fret does not
+        // page fault on the audio thread; the trimmed tail is let go
+        if (!error && bank.isMapped()) {
+            const SampleBank::Entry* e = bank.find(s, f);
+            if (e && !(e->flags & SampleBank::FLAG_COMPRESSED)) {
+                bank.release(*e, snd.size);
+                bank.touch(*e, snd.size);
+            }
+        }
+
+        snd.loaded = error == nullptr;
+        snd.failed = !snd.loaded;
+        errors[i] = error;
+    });
+
+    int loaded = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (!isAnchor(i % FRETS)) continue;
+
+        if (errors[i]) {
+            std::cout << "Sample " << stringNames[i / FRETS] << "/" << i % FRETS
+                << " failed to load: " << errors[i] << std::endl;
+        } else {
+            const Sound& snd = cachedSounds[i / FRETS][i % FRETS];
+            stats.residentBytes += residentSize(snd);
+            trimStats.bytesDropped += snd.untrimmedSize - snd.size;
+            loaded++;
+        }
+    }
+
+    return loaded;
+}
+
+bool AudioEngine::isAnchor(int fretIndex)
+{
+    if (fretIndex >= RECORDED_FRETS) return false;
+    return config.anchorInterval <= 1 || fretIndex % config.anchorInterval == 0;
+}
+
+int AudioEngine::anchorFor(int fretIndex)
+{
+    // the closest anchor, preferring the one above so the shift goes down
+    for (int d = 0; d < FRETS; d++)
+    {
+        if (fretIndex + d < FRETS && isAnchor(fretIndex + d)) return fretIndex + d;
+        if (fretIndex - d >= 0 && isAnchor(fretIndex - d)) return fretIndex - d;
+    }
+    return -1;
+}
+
+void AudioEngine::preparePlanar(Sound& snd)
+{
+    if (!config.planarFloat) return;
+
+    snd.planar.convert(snd.data, snd.size / snd.format.blockAlign, snd.format.channels,
+        snd.format.bitsPerSample, snd.format.formatTag == WavInfo::FORMAT_IEEE_FLOAT);
+}
+
+void AudioEngine::trimTail(Sound& snd)
+{
+    const SampleBank::Format& format = snd.format;
+    snd.untrimmedSize = snd.size;
+    if (!config.trimTails || snd.streamEntry) return;
+
+    uint32_t frames = snd.size / format.blockAlign;
+    bool isFloat = format.formatTag == WavInfo::FORMAT_IEEE_FLOAT;
+    uint32_t window = std::max<uint32_t>(1, format.sampleRate * ENVELOPE_WINDOW_MS / 1000);
+
+    TailAnalysis analysis = analyzeTail(snd.data, frames, format.channels, format.bitsPerSample,
+        isFloat, window, config.tailThresholdDb);
+    snd.envelopeDb.swap(analysis.envelopeDb);
+
+    // keep a short fade past the last audible window so the cut does not click
+    uint32_t fadeFrames = std::max<uint32_t>(1, format.sampleRate * TAIL_FADE_MS / 1000);
+    uint32_t keep = std::min(frames, analysis.audibleFrames + fadeFrames);
+    if (keep == frames) return;
+
+    snd.size = keep * format.blockAlign;
+
+    // mapped bank data is read only; it is cut where it is already below
+    // the threshold, and its tail pages are simply never touched
+    if (snd.samples.empty()) return;
+
+    size_t offset = snd.data - snd.samples.data();
+    snd.samples.resize(offset + snd.size);
+    snd.samples.shrink_to_fit();
+    snd.data = snd.samples.data() + offset;
+
+    fadeOutTail(snd.samples.data() + offset, keep, std::min(fadeFrames, keep),
+        format.channels, format.bitsPerSample, isFloat);
+}
+
+size_t AudioEngine::residentSize(const Sound& snd)
+{
+    return snd.size + snd.planar.bytes();
+}
+
+const char* AudioEngine::synthesizeSound(int stringIndex, int fretIndex, Sound& out)
+{
+    int anchor = anchorFor(fretIndex);
+    if (anchor < 0 || !acquireSound(stringIndex, anchor))
+        return "no anchor sample to synthesise from";
+
+    // pinned, so it cannot be evicted while it is read
+    const Sound& src = cachedSounds[stringIndex][anchor];
+    const char* error = nullptr;
+
+    // a streamed anchor only has its head resident, the shift needs all of it
+    std::vector<uint8_t> whole;
+    const uint8_t* input = src.data;
+    uint64_t inputBytes = src.size;
+    if (src.streamEntry) {
+        whole.resize((size_t)src.streamEntry->size);
+        input = whole.data();
+        inputBytes = whole.size();
+    }
+
+    if (src.format.formatTag != WavInfo::FORMAT_PCM || src.format.bitsPerSample != 16) {
+        error = "anchor sample is not 16-bit PCM";
+    } else if (src.streamEntry && !bank.read(*src.streamEntry, 0, whole.data(), whole.size())) {
+        error = "unreadable anchor sample";
+    } else {
+        Resampler resampler(Resampler::semitoneRatio(fretIndex - anchor));
+        uint32_t inputFrames = (uint32_t)(inputBytes / src.format.blockAlign);
+        uint32_t frames = resampler.outputFrames(inputFrames);
+
+        out.format = src.format;
+        out.samples.resize((size_t)frames * src.format.blockAlign);
+        resampler.process((const int16_t*)input, inputFrames, src.format.channels,
+            (int16_t*)out.samples.data());
+
+        out.data = out.samples.data();
+        out.size = (uint32_t)out.samples.size();
+        trimTail(out);
+        preparePlanar(out);
+
+        // measured against what the untrimmed anchor would have produced
+        uint64_t anchorBytes = src.streamEntry ? inputBytes : src.untrimmedSize;
+        out.untrimmedSize = resampler.outputFrames((uint32_t)(anchorBytes / src.format.blockAlign)) * src.format.blockAlign;
+    }
+
+    releaseSound(stringIndex, anchor);
+    return error;
+}
+
+const char* AudioEngine::loadSample(int stringIndex, int fretIndex, Sound& out)
+{
+    if (!isAnchor(fretIndex))
+        return synthesizeSound(stringIndex, fretIndex, out);
+
+    const char* error = bank.isOpen()
+        ? loadFromBank(stringIndex, fretIndex, out)
+        : loadLooseWav(stringIndex, fretIndex, out);
+
+    if (!error) error = validateSound(out);
+    if (!error) trimTail(out);
+    if (!error) preparePlanar(out);
+
+    // a mapped sample is only resident once its pages have been faulted in;
+    // the trimmed tail never needs to be
+    if (!error && bank.isMapped()) {
+        const SampleBank::Entry* e = bank.find(stringIndex, fretIndex);
+        if (e && !(e->flags & SampleBank::FLAG_COMPRESSED)) {
+            bank.release(*e, out.size);
+            bank.touch(*e, out.size);
+        }
+    }
+
+    return error;
+}
+
+bool AudioEngine::acquireSound(int stringIndex, int fretIndex)
+{
+    int id = stringIndex * FRETS + fretIndex;
+    Sound& snd = cachedSounds[stringIndex][fretIndex];
+
+    RealtimeGuard::blocking("residency lock");
+    std::unique_lock<std::mutex> lock(residencyMutex);
+
+    if (!snd.loaded && (config.lazyLoading || !isAnchor(fretIndex)) && !snd.failed)
+    {
+        stats.faultMisses++;
+
+        if (snd.loading) {
+            // the prefetcher is already on it
+            residencyChanged.wait(lock, [&]() { return !snd.loading; });
+        } else {
+            snd.loading = true;
+            lock.unlock();
+
+            Sound loaded;
+            const char* error = loadSample(stringIndex, fretIndex, loaded);
+
+            lock.lock();
+            installSound(id, loaded, error);
+        }
+    }
+
+    if (!snd.loaded) return false;
+
+    if (config.lazyLoading || !isAnchor(fretIndex))
+        lru.splice(lru.begin(), lru, snd.lruPos);
+
+    snd.pins++;
+    return true;
+}
+
+void AudioEngine::releaseSound(int stringIndex, int fretIndex)
+{
+    RealtimeGuard::blocking("residency lock");
+    std::lock_guard<std::mutex> lock(residencyMutex);
+    cachedSounds[stringIndex][fretIndex].pins--;
+}
+
+void AudioEngine::installSound(int id, Sound& loaded, const char* error)
+{
+    Sound& snd = cachedSounds[id / FRETS][id % FRETS];
+    snd.loading = false;
+
+    if (error) {
+        snd.failed = true;
+        std::cout << "Sample " << stringNames[id / FRETS] << "/" << id % FRETS
+            << " failed to load: " << error << std::endl;
+    } else {
+        snd.format = loaded.format;
+        snd.samples.swap(loaded.samples);
+        snd.planar.swap(loaded.planar);
+        snd.envelopeDb.swap(loaded.envelopeDb);
+        snd.data = loaded.data;
+        snd.size = loaded.size;
+        snd.untrimmedSize = loaded.untrimmedSize;
+        snd.streamEntry = loaded.streamEntry;
+        snd.loaded = true;
+
+        lru.push_front(id);
+        snd.lruPos = lru.begin();
+        stats.residentBytes += residentSize(snd);
+        lruBytes += residentSize(snd);
+        trimStats.bytesDropped += snd.untrimmedSize - snd.size;
+
+        evictOverBudget();
+    }
+
+    residencyChanged.notify_all();
+}
+
+void AudioEngine::evictSound(int id)
+{
+    Sound& snd = cachedSounds[id / FRETS][id % FRETS];
+
+    // synthesised frets have no bank entry
+    const SampleBank::Entry* e = bank.isMapped() ? bank.find(id / FRETS, id % FRETS) : nullptr;
+    if (e) bank.release(*e);
+
+    lru.erase(snd.lruPos);
+    lruBytes -= residentSize(snd);
+    stats.residentBytes -= residentSize(snd);
+
+    std::vector<uint8_t>().swap(snd.samples);
+    snd.planar.clear();
+    std::vector<float>().swap(snd.envelopeDb);
+    snd.data = nullptr;
+    snd.loaded = false;
+    stats.evictions++;
+}
+
+void AudioEngine::evictOverBudget()
+{
+    // never evicts the most recent sample or one a voice is still playing
+    auto it = lru.end();
+    while (lruBytes > config.residentBudgetBytes)
+    {
+        auto victim = std::prev(it);
+        if (victim == lru.begin()) break;
+
+        int id = *victim;
+        if (cachedSounds[id / FRETS][id % FRETS].pins > 0) {
+            it = victim;
+            continue;
+        }
+
+        evictSound(id);
+    }
+}
+
+void AudioEngine::requestPrefetch(int stringIndex, int fretIndex)
+{
+    if (stringIndex < 0 || stringIndex >= STRINGS ||
+        fretIndex < 0 || fretIndex >= FRETS)
+        return;
+
+    {
+        RealtimeGuard::blocking("residency lock");
+        std::lock_guard<std::mutex> lock(residencyMutex);
+        Sound& snd = cachedSounds[stringIndex][fretIndex];
+        if (snd.loaded || snd.loading || snd.failed || snd.queued) return;
+
+        // every sound is queued at most once, so the ring never overflows
+        snd.queued = true;
+        prefetchQueue[(prefetchHead + prefetchCount++) % prefetchQueue.size()] = stringIndex * FRETS + fretIndex;
+    }
+
+    prefetchWake.notify_one();
+}
+
+void AudioEngine::prefetchLoop()
+{
+    std::unique_lock<std::mutex> lock(residencyMutex);
+
+    while (true)
+    {
+        prefetchWake.wait(lock, []() { return prefetchStop || prefetchCount > 0; });
+        if (prefetchStop) return;
+
+        int id = prefetchQueue[prefetchHead];
+        prefetchHead = (prefetchHead + 1) % (int)prefetchQueue.size();
+        prefetchCount--;
+
+        Sound& snd = cachedSounds[id / FRETS][id % FRETS];
+        snd.queued = false;
+        if (snd.loaded || snd.loading || snd.failed) continue;
+
+        snd.loading = true;
+        lock.unlock();
+
+        Sound loaded;
+        const char* error = loadSample(id / FRETS, id % FRETS, loaded);
+
+        lock.lock();
+        installSound(id, loaded, error);
+        stats.prefetches++;
+    }
+}
+
+void AudioEngine::setChordShape(const std::array<int, 6>& frets)
+{
+    if (frets == chordShape) return;
+    chordShape = frets;
+
+    for (int s = 0; s < STRINGS; s++)
+        requestPrefetch(s, frets[s]);
+}
+
+ResidencyStats AudioEngine::residencyStats()
+{
+    std::lock_guard<std::mutex> lock(residencyMutex);
+    return stats;
+}
+
+TailStats AudioEngine::tailStats()
+{
+    std::lock_guard<std::mutex> lock(residencyMutex);
+    return trimStats;
+}
+
+CommandStats AudioEngine::commandStats()
+{
+    return queueStats;
+}
+
+VoiceStats AudioEngine::voiceStats()
+{
+    VoiceStats vs;
+    unsigned long long blocks = voiceBlocks.load(std::memory_order_relaxed);
+    vs.peakVoices = peakVoices.load(std::memory_order_relaxed);
+    vs.averageVoices = blocks ? (double)voiceBlockSum.load(std::memory_order_relaxed) / blocks : 0.0;
+    vs.takeovers = takeovers.load(std::memory_order_relaxed);
+    vs.steals = steals.load(std::memory_order_relaxed);
+    vs.cuts = cuts.load(std::memory_order_relaxed);
+    vs.slides = slides.load(std::memory_order_relaxed);
+
+    vs.ended = endedVoices.load(std::memory_order_relaxed);
+    vs.averageLifetime = vs.ended ? (double)lifetimeFrames.load(std::memory_order_relaxed) / vs.ended / Mixer::SAMPLE_RATE : 0.0;
+    vs.longestLifetime = (double)longestLifetime.load(std::memory_order_relaxed) / Mixer::SAMPLE_RATE;
+    return vs;
+}
+
+RenderStats AudioEngine::renderStats()
+{
+    Mixer::Timing t = mixer.timing();
+
+    RenderStats rs;
+    rs.blocks = t.blocks;
+    rs.averageLoad = t.averageLoad;
+    rs.worstLoad = t.worstLoad;
+    rs.worstMs = t.worstSeconds * 1000.0;
+    rs.late = t.late;
+    rs.xruns = backend ? backend->xruns() : 0;
+    rs.violations = RealtimeGuard::violations();
+    return rs;
+}
+
+double AudioEngine::outputLatencyMs()
+{
+    if (!backend) return 0.0;
+    return (double)(mixer.blockFrames() + backend->queuedFrames()) * 1000.0 / Mixer::SAMPLE_RATE;
+}
+
+StreamStats AudioEngine::streamStats()
+{
+    StreamStats ss;
+    ss.underruns = mixer.underruns();
+    ss.readErrors = streamer.readErrors();
+    ss.bytesStreamed = streamer.bytesRead();
+    return ss;
+}
+
+const char* AudioEngine::loadFromBank(int stringIndex, int fretIndex, Sound& out)
+{
+    const SampleBank::Entry* e = bank.find(stringIndex, fretIndex);
+    if (!e) return "not present in the sample bank";
+
+    out.format = e->format;
+
+    if (e->flags & SampleBank::FLAG_COMPRESSED)
+    {
+        // compressed samples are never streamed, they are decoded whole
+        std::vector<uint8_t> packed;
+        const uint8_t* src = bank.data(*e);
+        if (!bank.isMapped()) {
+            packed.resize((size_t)e->size);
+            if (!bank.read(*e, 0, packed.data(), packed.size())) return "unreadable sample bank entry";
+            src = packed.data();
+        }
+
+        uint16_t channels = 0;
+        uint32_t frames = SampleCodec::frameCount(src, (size_t)e->size, channels);
+        if (frames == 0 || channels != e->format.channels || e->format.bitsPerSample != 16)
+            return "corrupt compressed sample";
+
+        out.samples.resize((size_t)frames * e->format.blockAlign);
+        if (!SampleCodec::decode(src, (size_t)e->size, (int16_t*)out.samples.data()))
+            return "corrupt compressed sample";
+
+        out.data = out.samples.data();
+        out.size = (uint32_t)out.samples.size();
+        return nullptr;
+    }
+
+    if (bank.isMapped()) {
+        // points straight into the mapping, no copy
+        out.data = bank.data(*e);
+        out.size = (uint32_t)e->size;
+        return nullptr;
+    }
+
+    // streamed: only the head is read now, the rest when a voice plays it
+    uint64_t blockAlign = std::max<uint64_t>(1, e->format.blockAlign);
+    uint64_t head = (uint64_t)e->format.sampleRate * config.streamHeadMs / 1000 * blockAlign;
+    head = std::max(blockAlign, std::min(head, e->size / blockAlign * blockAlign));
+
+    out.samples.resize((size_t)head);
+    if (!bank.read(*e, 0, out.samples.data(), out.samples.size())) return "unreadable sample bank entry";
+
+    out.data = out.samples.data();
+    out.size = (uint32_t)head;
+    if (head < e->size) out.streamEntry = e;
+
+    return nullptr;
+}
+
+const char* AudioEngine::loadLooseWav(int stringIndex, int fretIndex, Sound& out)
+{
+    return loadWav(samplePath(stringIndex, fretIndex), out);
+}
+
+const char* AudioEngine::validateSound(const Sound& snd)
+{
+    const SampleBank::Format& format = snd.format;
+
+    bool pcm = format.formatTag == WavInfo::FORMAT_PCM &&
+        (format.bitsPerSample == 16 || format.bitsPerSample == 24 || format.bitsPerSample == 32);
+    bool ieee = format.formatTag == WavInfo::FORMAT_IEEE_FLOAT && format.bitsPerSample == 32;
+
+    if (!pcm && !ieee) return "unsupported sample format";
+    if (format.channels < 1 || format.channels > 2) return "unsupported channel count";
+    if (format.blockAlign != format.channels * format.bitsPerSample / 8) return "inconsistent block alignment";
+    if (format.sampleRate != Mixer::SAMPLE_RATE) return "sample rate differs from the mixer rate";
+    if (!snd.data || snd.size == 0) return "no sample data";
+    if (snd.size % format.blockAlign != 0) return "sample data is not a whole number of frames";
+
+    return nullptr;
+}
+
+bool AudioEngine::packBank(const std::string& path, bool compress)
+{
+    std::vector<SampleBank::Entry> entries;
+    std::vector<const uint8_t*> blobs;
+    std::vector<std::vector<uint8_t>> compressed(STRINGS * FRETS);
+    size_t rawBytes = 0;
+    size_t packedBytes = 0;
 
     for (int s = 0; s < STRINGS; s++)
     {
-        for (int f = 0; f < FRETS; f++)
+        for (int f = 0; f < RECORDED_FRETS; f++)
         {
-            std::string path =
-                "res/audio/" + stringNames[s] + "/" + std::to_string(f) + ".wav";
+            std::string wavPath = samplePath(s, f);
+
+            Sound& snd = cachedSounds[s][f];
+            const char* error = loadWav(wavPath, snd);
+            if (error) {
+                std::cout << "Skipping sample \"" << wavPath << "\": " << error << std::endl;
+                continue;
+            }
+
+            SampleBank::Entry e{};
+            e.stringIndex = (uint16_t)s;
+            e.fretIndex = (uint16_t)f;
+            e.format = snd.format;
+            e.size = snd.size;
+            blobs.push_back(snd.data);
 
-            loadWav(path, cachedSounds[s][f]);
+            if (compress && snd.format.formatTag == WavInfo::FORMAT_PCM && snd.format.bitsPerSample == 16)
+            {
+                std::vector<uint8_t>& c = compressed[s * FRETS + f];
+                c = SampleCodec::encode((const int16_t*)snd.data,
+                    snd.size / snd.format.blockAlign, snd.format.channels);
+
+                if (!c.empty()) {
+                    e.flags |= SampleBank::FLAG_COMPRESSED;
+                    e.size = c.size();
+                    blobs.back() = c.data();
+                }
+            }
+
+            rawBytes += snd.size;
+            packedBytes += (size_t)e.size;
+            entries.push_back(e);
         }
     }
 
-    return true;
+    bool ok = SampleBank::write(path, entries, blobs);
+    std::cout << (ok ? "Packed " : "Failed to pack ") << entries.size()
+        << " samples into \"" << path << "\"";
+    if (compress)
+        std::cout << ", compression ratio " << (double)rawBytes / packedBytes;
+    std::cout << std::endl;
+
+    return ok;
 }
 
 void AudioEngine::shutdown()
 {
-    for (auto& v : activeVoices)
-        if (v.voice) v.voice->DestroyVoice();
+    if (offline) {
+        std::cout << "Offline render: " << (double)offline->clock() / Mixer::SAMPLE_RATE
+            << " s of audio at " << offline->realTimeFactor() << "x real time" << std::endl;
+    }
+
+    RenderStats rs = renderStats();
+    std::cout << "Audio thread: " << rs.blocks << " blocks, " << rs.averageLoad * 100.0 << "% of the deadline on average, "
+        << rs.worstLoad * 100.0 << "% (" << rs.worstMs << " ms) at worst, " << rs.late << " late, "
+        << rs.xruns << " xruns, " << mixer.blockFrames() << "-frame blocks, " << outputLatencyMs() << " ms output latency";
+    if (RealtimeGuard::enabled) std::cout << ", " << rs.violations << " real-time violations";
+    std::cout << std::endl;
+
+    // no more blocks get pulled once the backend is closed
+    if (backend) {
+        backend->close();
+        backend.reset();
+        offline = nullptr;
+    }
+
+    if (!config.impulseResponsePath.empty()) {
+        convolver.stop();
+        mixer.setEffect(nullptr);
+        std::cout << "Convolution: " << convolver.workerSeconds() << " s on the tail worker, "
+            << convolver.lateTails() << " tail partitions late" << std::endl;
+    }
+
+    // with the audio thread gone its voices and queued commands are ours;
+    // stopping everything first keeps a slide handed back from being played
+    stopAllGeneration.fetch_add(1, std::memory_order_relaxed);
+    processCommands(nullptr);
+    cancelScheduled(-1);
+    for (int i = activeVoices.first(); i >= 0; )
+    {
+        int next = activeVoices.after(i);
+        retireVoice(i);
+        i = next;
+    }
+    collectGarbage();
+
+    std::cout << "Note commands: " << queueStats.commands << " queued, peak depth "
+        << queueStats.peakDepth << " of " << COMMAND_QUEUE_SIZE << ", "
+        << queueStats.overflows << " dropped on overflow" << std::endl;
+
+    VoiceStats vs = voiceStats();
+    std::cout << "Voices: peak " << vs.peakVoices << ", average " << vs.averageVoices << " per block, "
+        << vs.takeovers << " taken over on their string, " << vs.steals << " stolen, " << vs.cuts << " cut, "
+        << vs.slides << " slid to a new fret, "
+        << vs.ended << " ended after " << vs.averageLifetime << " s on average, "
+        << vs.longestLifetime << " s at most" << std::endl;
+
+    if (prefetchThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(residencyMutex);
+            prefetchStop = true;
+        }
+        prefetchWake.notify_one();
+        prefetchThread.join();
+
+        ResidencyStats rs = residencyStats();
+        std::cout << "Sample residency: " << rs.faultMisses << " fault-in misses, "
+            << rs.prefetches << " prefetches, " << rs.evictions << " evictions" << std::endl;
+    }
 
-    activeVoices.clear();
+    if (config.trimTails && config.notes == NoteSource::Samples) {
+        TailStats ts = tailStats();
+        std::cout << "Tail trimming: " << ts.bytesDropped / (1024.0 * 1024.0) << " MB of inaudible tails dropped";
+        if (ts.notes > 0)
+            std::cout << ", average voice lifetime " << ts.untrimmedSeconds / ts.notes << " s -> "
+                << ts.voiceSeconds / ts.notes << " s over " << ts.notes << " notes";
+        std::cout << std::endl;
+    }
+
+    if (config.streamFromDisk && bank.isOpen()) {
+        StreamStats ss = streamStats();
+        std::cout << "Disk streaming: " << ss.bytesStreamed / (1024.0 * 1024.0) << " MB read, "
+            << ss.underruns << " underruns, " << ss.readErrors << " read errors" << std::endl;
+    }
 
-    if (masterVoice) masterVoice->DestroyVoice();
-    if (xaudio) xaudio->Release();
+    streamer.stop();
+    bank.close();
+
+    // nothing may survive into the next init: the samples pointed into the
+    // bank just closed, and the residency bookkeeping described them
+    for (auto& row : cachedSounds)
+        for (Sound& snd : row)
+            snd = Sound();
+    lru.clear();
+    lruBytes = 0;
+    stats = ResidencyStats();
+}
+
+int AudioEngine::stringIndexOf(const std::string& stringName)
+{
+    for (int s = 0; s < STRINGS; s++)
+        if (stringNames[s] == stringName) return s;
+    return -1;
+}
+
+bool AudioEngine::sendCommand(const Command& cmd)
+{
+    if (!commands.push(cmd)) {
+        queueStats.overflows++;
+        return false;
+    }
+
+    queueStats.commands++;
+    queueStats.peakDepth = std::max(queueStats.peakDepth, commands.size());
+    return true;
 }
 
 void AudioEngine::playNote(std::string stringName, int fretIndex, float volume)
 {
-    int stringIndex = -1;
+    playNoteAt(0, stringName, fretIndex, volume);
+}
+
+void AudioEngine::playNoteAt(uint64_t frame, std::string stringName, int fretIndex, float volume)
+{
+    queueNote(Command::Type::Play, frame, stringName, fretIndex, volume);
+}
+
+void AudioEngine::slideNote(std::string stringName, int fretIndex, float volume)
+{
+    // a synthesised string would have to retune its loop as it went
+    if (!config.legatoSlides || config.notes != NoteSource::Samples) {
+        playNote(stringName, fretIndex, volume);
+        return;
+    }
+
+    queueNote(Command::Type::Slide, 0, stringName, fretIndex, volume);
+}
 
-    if (stringName == "E") stringIndex = 0;
-    else if (stringName == "A") stringIndex = 1;
-    else if (stringName == "D") stringIndex = 2;
-    else if (stringName == "G") stringIndex = 3;
-    else if (stringName == "B") stringIndex = 4;
-    else if (stringName == "Eh") stringIndex = 5;
-    else return;
+void AudioEngine::queueNote(Command::Type type, uint64_t frame, const std::string& stringName, int fretIndex, float volume)
+{
+    int stringIndex = stringIndexOf(stringName);
 
     if (stringIndex < 0 || stringIndex >= STRINGS ||
         fretIndex < 0 || fretIndex >= FRETS)
         return;
 
+    // the voice could not be handed back once the audio thread finishes it
+    if (notesInFlight >= retiredVoices.capacity()) {
+        queueStats.overflows++;
+        return;
+    }
+
+    Command cmd;
+    cmd.type = type;
+    cmd.generation = stopAllGeneration.load(std::memory_order_relaxed);
+    cmd.frame = frame;
+    cmd.stringIndex = stringIndex;
+    cmd.fretIndex = fretIndex;
+    cmd.gain = volume;
+
+    // plucked by the audio thread, in the slot the voice gets or the bank
+    if (config.notes != NoteSource::Samples) {
+        if (sendCommand(cmd)) notesInFlight++;
+        return;
+    }
+
+    // a slide mostly glides the voice already sounding, so loading or pinning
+    // the target at every fret crossed would be wasted; it is only loaded
+    // ahead, for when the string has gone quiet and it is played after all
+    bool slide = type == Command::Type::Slide;
+    if (slide) requestPrefetch(stringIndex, fretIndex);
+    else if (!acquireSound(stringIndex, fretIndex)) return;
+
+    for (int d = 1; d <= config.prefetchRadius; d++)
+    {
+        requestPrefetch(stringIndex, fretIndex - d);
+        requestPrefetch(stringIndex, fretIndex + d);
+    }
+
+    if (slide) {
+        if (sendCommand(cmd)) notesInFlight++;
+        return;
+    }
+
     Sound& snd = cachedSounds[stringIndex][fretIndex];
-    if (!snd.loaded) return;
 
-    Voice inst;
-    if (FAILED(xaudio->CreateSourceVoice(&inst.voice, &snd.wfx)))
+    Mixer::Source& source = cmd.source;
+    source.data = snd.data;
+    source.frames = snd.size / snd.format.blockAlign;
+    source.channels = snd.format.channels;
+    source.encoding = encodingOf(snd.format);
+    if (!snd.planar.empty()) {
+        source.planar[0] = snd.planar.channel(0);
+        source.planar[1] = snd.planar.channel(snd.planar.channelCount() - 1);
+    }
+
+    if (!snd.envelopeDb.empty()) {
+        cmd.envelopeDb = snd.envelopeDb.data();
+        cmd.envelopeWindows = (uint32_t)snd.envelopeDb.size();
+    }
+
+    // a streamed sample continues from the disk after its resident head
+    if (snd.streamEntry) {
+        cmd.stream = streamer.open(*snd.streamEntry, snd.size);
+        source.streamer = &streamer;
+        source.stream = cmd.stream;
+    }
+
+    if (!sendCommand(cmd)) {
+        streamer.close(cmd.stream);
+        releaseSound(stringIndex, fretIndex);
         return;
+    }
+    notesInFlight++;
 
-    XAUDIO2_BUFFER buf{};
-    buf.AudioBytes = snd.samples.size();
-    buf.pAudioData = snd.samples.data();
-    buf.Flags = XAUDIO2_END_OF_STREAM;
+    {
+        RealtimeGuard::blocking("residency lock");
+        std::lock_guard<std::mutex> lock(residencyMutex);
+        double rate = (double)snd.format.sampleRate * snd.format.blockAlign;
+        double untrimmed = snd.streamEntry ? (double)snd.streamEntry->size : snd.untrimmedSize;
+        double played = snd.streamEntry ? (double)snd.streamEntry->size : snd.size;
+        trimStats.notes++;
+        trimStats.voiceSeconds += played / rate;
+        trimStats.untrimmedSeconds += untrimmed / rate;
+    }
+}
+
+void AudioEngine::stopNotes(std::string stringName)
+{
+    Command cmd;
+    cmd.type = Command::Type::Stop;
+    cmd.stringIndex = stringIndexOf(stringName);
+    if (cmd.stringIndex >= 0) sendCommand(cmd);
+}
+
+void AudioEngine::stopAllNotes()
+{
+    stopAllGeneration.fetch_add(1, std::memory_order_release);
+}
+
+void AudioEngine::setGain(float gain)
+{
+    Command cmd;
+    cmd.type = Command::Type::SetGain;
+    cmd.gain = gain;
+    sendCommand(cmd);
+}
 
-    inst.voice->SubmitSourceBuffer(&buf);
-    inst.voice->SetVolume(volume);
-    inst.voice->Start();
+void AudioEngine::advance(uint64_t frames)
+{
+    if (!offline) return;
 
-    activeVoices.push_back(inst);
+    offline->advance(frames);
+    collectGarbage();
+}
+
+uint64_t AudioEngine::clock()
+{
+    return mixer.clock();
+}
+
+uint64_t AudioEngine::frameAt(std::chrono::steady_clock::time_point t)
+{
+    if (offline) return mixer.clock();
+
+    uint32_t before, after;
+    uint64_t frame;
+    int64_t nanos;
+    do {
+        before = stampSequence.load(std::memory_order_acquire);
+        frame = stampFrame.load(std::memory_order_relaxed);
+        nanos = stampNanos.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = stampSequence.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1));
+
+    int64_t since = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count() - nanos;
+    int64_t frames = since * (int64_t)Mixer::SAMPLE_RATE / 1000000000;
+    return frames < 0 && (uint64_t)-frames > frame ? 0 : frame + frames;
 }
 
 void AudioEngine::collectGarbage()
 {
-    for (size_t i = 0; i < activeVoices.size(); )
+    // may wait on the streamer and the residency lock, which the audio
+    // thread never does
+    Voice v;
+    while (retiredVoices.pop(v))
     {
-        XAUDIO2_VOICE_STATE st{};
-        activeVoices[i].voice->GetState(&st);
+        if (config.notes == NoteSource::Samples && v.pinned) releaseSound(v.stringIndex, v.fretIndex);
+        streamer.close(v.stream);
+        notesInFlight--;
 
-        if (st.BuffersQueued == 0)
-        {
-            activeVoices[i].voice->DestroyVoice();
-            activeVoices.erase(activeVoices.begin() + i);
+        if (v.replay && v.generation == stopAllGeneration.load(std::memory_order_relaxed))
+            playNote(stringNames[v.stringIndex], v.fretIndex, v.gain);
+    }
+}
+
+// audio thread from here on
+
+void AudioEngine::processCommands(void*)
+{
+    // the coming block covers frames [now, now + frames), at most a whole block
+    uint64_t now = mixer.clock();
+    stampClock(now);
+
+    // read before the queue, so every note queued before the stop is older
+    uint32_t generation = stopAllGeneration.load(std::memory_order_acquire);
+    if (generation != stoppedGeneration) applyStopAll(generation);
+
+    Command cmd;
+    while (commands.pop(cmd))
+    {
+        // a note from after a stop made since the load above stops
+        // everything before it first; one from before the stop is dropped
+        int32_t age = (int32_t)(cmd.generation - stoppedGeneration);
+        bool isNote = cmd.type == Command::Type::Play || cmd.type == Command::Type::Slide;
+        if (isNote && age > 0) applyStopAll(cmd.generation);
+
+        switch (cmd.type) {
+        case Command::Type::Play:
+            if (age < 0) retireCommand(cmd);
+            else if (cmd.frame >= now + mixer.blockFrames()) schedule(cmd);
+            else startVoice(cmd, now);
+            break;
+        case Command::Type::Slide:
+            if (age < 0) retireCommand(cmd);
+            else slideVoice(cmd);
+            break;
+        case Command::Type::Stop:
+            cancelScheduled(cmd.stringIndex);
+            for (int i = activeVoices.first(); i >= 0; i = activeVoices.after(i))
+                if (activeVoices[i].stringIndex == cmd.stringIndex) releaseVoice(i, 0);
+            if (config.notes == NoteSource::StringBank)
+                stringBank.damp(cmd.stringIndex, Mixer::SAMPLE_RATE * config.releaseMs / 1000);
+            break;
+        case Command::Type::SetGain:
+            mixer.setGain(cmd.gain);
+            break;
+        }
+    }
+
+    // a partial offline block may leave a due note for the next one, the
+    // mixer delays it the rest of the way
+    while (scheduledCount > 0 && scheduled[0].frame < now + mixer.blockFrames())
+    {
+        // popped first, startVoice may schedule it again for a later block
+        std::pop_heap(scheduled.begin(), scheduled.begin() + scheduledCount--, laterNote);
+        Command due = scheduled[scheduledCount];
+        startVoice(due, now);
+    }
+
+    int voices = activeVoices.size();
+    voiceBlocks.store(voiceBlocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    voiceBlockSum.store(voiceBlockSum.load(std::memory_order_relaxed) + voices, std::memory_order_relaxed);
+    if (voices > peakVoices.load(std::memory_order_relaxed))
+        peakVoices.store(voices, std::memory_order_relaxed);
+}
+
+void AudioEngine::applyStopAll(uint32_t generation)
+{
+    stoppedGeneration = generation;
+    cancelScheduled(-1);
+    for (int i = activeVoices.first(); i >= 0; i = activeVoices.after(i))
+        releaseVoice(i, 0);
+    if (config.notes == NoteSource::StringBank) {
+        for (int s = 0; s < STRINGS; s++)
+            stringBank.damp(s, Mixer::SAMPLE_RATE * config.releaseMs / 1000);
+    }
+}
+
+// heap order for scheduled notes: the earliest on top, in the order they came
+bool AudioEngine::laterNote(const Command& a, const Command& b)
+{
+    return a.frame != b.frame ? a.frame > b.frame : a.order > b.order;
+}
+
+void AudioEngine::stampClock(uint64_t now)
+{
+    int64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    uint32_t sequence = stampSequence.load(std::memory_order_relaxed);
+    stampSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    stampFrame.store(now, std::memory_order_relaxed);
+    stampNanos.store(nanos, std::memory_order_relaxed);
+    stampSequence.store(sequence + 2, std::memory_order_release);
+}
+
+void AudioEngine::schedule(const Command& cmd)
+{
+    // cannot be full, see scheduled
+    scheduled[scheduledCount] = cmd;
+    scheduled[scheduledCount].order = scheduleOrder++;
+    std::push_heap(scheduled.begin(), scheduled.begin() + ++scheduledCount, laterNote);
+}
+
+void AudioEngine::cancelScheduled(int stringIndex)
+{
+    int kept = 0;
+    for (int i = 0; i < scheduledCount; i++)
+    {
+        if (stringIndex < 0 || scheduled[i].stringIndex == stringIndex)
+            retireCommand(scheduled[i]);
+        else
+            scheduled[kept++] = scheduled[i];
+    }
+
+    scheduledCount = kept;
+    std::make_heap(scheduled.begin(), scheduled.begin() + scheduledCount, laterNote);
+}
+
+void AudioEngine::retireCommand(const Command& cmd)
+{
+    Voice v;
+    v.stringIndex = cmd.stringIndex;
+    v.fretIndex = cmd.fretIndex;
+    v.stream = cmd.stream;
+    v.pinned = cmd.type != Command::Type::Slide;
+    retiredVoices.push(v);
+}
+
+void AudioEngine::startVoice(const Command& cmd, uint64_t now)
+{
+    uint32_t delay = cmd.frame > now ? (uint32_t)(cmd.frame - now) : 0;
+
+    // the bank already sounds every string; the note only plucks its own
+    if (config.notes == NoteSource::StringBank) {
+        stringBank.pluck(cmd.stringIndex, cmd.fretIndex, cmd.gain, ++plucks, delay);
+        retireCommand(cmd);
+        return;
+    }
+
+    Voice v;
+    v.stringIndex = cmd.stringIndex;
+    v.fretIndex = cmd.fretIndex;
+    v.stream = cmd.stream;
+    v.gain = cmd.gain;
+    v.envelopeDb = cmd.envelopeDb;
+    v.envelopeWindows = cmd.envelopeWindows;
+
+    int sounding = 0;
+    for (int i = activeVoices.first(); i >= 0; i = activeVoices.after(i))
+    {
+        if (activeVoices[i].fading) continue;
+
+        if (config.monophonic && activeVoices[i].stringIndex == cmd.stringIndex) {
+            releaseVoice(i, delay);
+            takeovers.store(takeovers.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
         } else {
-            i++;
+            sounding++;
+        }
+    }
+
+    for (; sounding >= config.maxVoices; sounding--)
+    {
+        releaseVoice(stealVictim(), delay);
+        steals.store(steals.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // with every slot taken, a voice released by the steals above makes room
+    // once its release is over: the note waits for it, a block or so, rather
+    // than cutting a voice off mid-ramp
+    if (activeVoices.size() == activeVoices.capacity()) {
+        uint64_t releaseFrames = Mixer::SAMPLE_RATE * config.releaseMs / 1000;
+        int victim = -1;
+        for (int i = activeVoices.first(); i >= 0; i = activeVoices.after(i))
+        {
+            if (activeVoices[i].fading && (victim < 0 || activeVoices[i].releaseFrame < activeVoices[victim].releaseFrame))
+                victim = i;
         }
+
+        if (victim >= 0 && activeVoices[victim].releaseFrame + releaseFrames > now) {
+            Command later = cmd;
+            later.frame = std::max(activeVoices[victim].releaseFrame + releaseFrames, now + mixer.blockFrames());
+            schedule(later);
+            return;
+        }
+
+        if (victim < 0) {
+            victim = activeVoices.first();
+            cuts.store(cuts.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        retireVoice(victim);
     }
+
+    int slot = activeVoices.acquire();
+    Mixer::Source source = cmd.source;
+    if (slot >= 0 && config.notes == NoteSource::Synthesis) {
+        synthVoices[slot].pluck(config.strings[cmd.stringIndex], cmd.fretIndex, ++plucks);
+        source.generator = &synthVoices[slot];
+    }
+    if (slot >= 0) v.mixerVoice = mixer.play(source, cmd.gain, delay, (uint32_t)slot);
+
+    // every voice taken: the note is dropped and its sample handed back
+    if (!v.mixerVoice) {
+        if (slot >= 0) activeVoices.release(slot);
+        retiredVoices.push(v);
+        return;
+    }
+
+    activeVoices[slot] = v;
+}
+
+void AudioEngine::retireVoice(int slot)
+{
+    Voice& v = activeVoices[slot];
+    mixer.remove(v.mixerVoice);
+    retiredVoices.push(v);
+    activeVoices.release(slot);
 }
 
-void AudioEngine::stopAllNotes() {
-    for (size_t i = 0; i < activeVoices.size(); i++)
+void AudioEngine::slideVoice(const Command& cmd)
+{
+    // the latest note still sounding on the string
+    int slot = -1;
+    for (int i = activeVoices.first(); i >= 0; i = activeVoices.after(i))
+        if (!activeVoices[i].fading && activeVoices[i].stringIndex == cmd.stringIndex) slot = i;
+
+    // only the UI thread can pin the fret's sample to play it
+    if (slot < 0 || mixer.finished(activeVoices[slot].mixerVoice)) {
+        Voice v;
+        v.stringIndex = cmd.stringIndex;
+        v.fretIndex = cmd.fretIndex;
+        v.gain = cmd.gain;
+        v.pinned = false;
+        v.replay = true;
+        v.generation = cmd.generation;
+        retiredVoices.push(v);
+        return;
+    }
+
+    // relative to the sample the voice is reading, which keeps its fret so
+    // the right one is released at the end
+    Voice& v = activeVoices[slot];
+    float rate = std::pow(2.0f, (cmd.fretIndex - v.fretIndex) / 12.0f);
+    mixer.glide(v.mixerVoice, rate, Mixer::SAMPLE_RATE * config.slideMs / 1000);
+    slides.store(slides.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    retireCommand(cmd);
+}
+
+void AudioEngine::releaseVoice(int slot, uint32_t delay)
+{
+    Voice& v = activeVoices[slot];
+    if (v.fading) return;
+
+    mixer.fadeOut(v.mixerVoice, Mixer::SAMPLE_RATE * config.releaseMs / 1000, delay);
+    v.fading = true;
+    v.releaseFrame = mixer.clock() + delay;
+}
+
+int AudioEngine::stealVictim()
+{
+    // ties go to the older voice
+    int victim = -1;
+    float victimDb = 0.0f;
+
+    for (int i = activeVoices.first(); i >= 0; i = activeVoices.after(i))
     {
-        activeVoices[i].voice->DestroyVoice();
-        activeVoices.erase(activeVoices.begin() + i);
+        if (activeVoices[i].fading) continue;
+        if (config.stealPolicy == VoiceSteal::Oldest) return i;
+
+        float db = voiceLevelDb(i);
+        if (victim < 0 || db < victimDb) {
+            victim = i;
+            victimDb = db;
+        }
     }
-}
\ No newline at end of file
+
+    return victim;
+}
+
+float AudioEngine::voiceLevelDb(int slot)
+{
+    const Voice& v = activeVoices[slot];
+    float db = 20.0f * std::log10(std::max(v.gain, 1e-6f));
+    if (config.notes == NoteSource::Synthesis) return db + synthVoices[slot].levelDb();
+    if (!v.envelopeDb) return db;
+
+    // the envelope was measured in windows of ENVELOPE_WINDOW_MS; all voices
+    // play at the mixer rate
+    uint64_t window = mixer.framesPlayed(v.mixerVoice) / (Mixer::SAMPLE_RATE * ENVELOPE_WINDOW_MS / 1000);
+    return db + (window < v.envelopeWindows ? v.envelopeDb[window] : v.envelopeDb[v.envelopeWindows - 1]);
+}
+
+void AudioEngine::voiceEnded(uint32_t, uint32_t slot, uint64_t played, void*)
+{
+    // the mixer reports each voice once, right after the block it ended in,
+    // so nothing has to poll the others
+    endedVoices.store(endedVoices.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    lifetimeFrames.store(lifetimeFrames.load(std::memory_order_relaxed) + played, std::memory_order_relaxed);
+    if (played > longestLifetime.load(std::memory_order_relaxed))
+        longestLifetime.store(played, std::memory_order_relaxed);
+
+    retireVoice((int)slot);
+}
@@ -1,41 +1,420 @@
 #pragma once
-#include <xaudio2.h>
 #include <string>
 #include <vector>
 #include <array>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include "SampleBank.h"
+#include "PlanarSamples.h"
+#include "SampleStreamer.h"
+#include "Mixer.h"
+#include "SpscQueue.h"
+#include "AudioBackend.h"
+#include "KarplusStrong.h"
+#include "StringBank.h"
+#include "Convolver.h"
+
+class OfflineBackend;
+
+enum class AudioOutput { Device, Offline };
+enum class VoiceSteal { Quietest, Oldest };
+enum class NoteSource { Samples, Synthesis, StringBank };
+
+struct AudioConfig
+{
+    // the sound device, or an offline render driven by AudioEngine::advance
+    // into offlineWavPath (nowhere when empty)
+    AudioOutput output = AudioOutput::Device;
+    std::string offlineWavPath;
+
+    // the ALSA PCM played through on Linux; "null" or a file plugin work
+    // without sound hardware
+    std::string alsaDevice = "default";
+
+    // notes from the recordings, or from a Karplus-Strong string model per
+    // string. Synthesis loads no samples, plays every fret, and takes its
+    // tuning and tone from `strings`, low E first. StringBank runs all six
+    // strings together, coupled through the bridge by bridgeCoupling so open
+    // strings ring along sympathetically; it is one note per string whatever
+    // monophonic and maxVoices say
+    NoteSource notes = NoteSource::Samples;
+    std::array<StringModel, 6> strings = { {
+        { 82.41f, 4.0f, 0.13f, 0.4f, 0.1f },
+        { 110.00f, 3.6f, 0.13f, 0.4f, 0.1f },
+        { 146.83f, 3.2f, 0.13f, 0.45f, 0.08f },
+        { 196.00f, 2.8f, 0.13f, 0.5f, 0.06f },
+        { 246.94f, 2.4f, 0.13f, 0.55f, 0.04f },
+        { 329.63f, 2.0f, 0.13f, 0.6f, 0.02f },
+    } };
+    float bridgeCoupling = 0.0005f;
+
+    // convolve the output with this impulse response, a guitar body or a
+    // room (a 44.1 kHz WAV, mono or stereo); none when empty.
+    // impulseResponseMix goes from the dry output at 0 to only the
+    // convolved one at 1
+    std::string impulseResponsePath;
+    float impulseResponseMix = 1.0f;
+
+    // worker threads used to load the samples, 0 uses one per hardware thread
+    int loaderThreads = 0;
+
+    // load samples on first use instead of up front, keeping at most
+    // residentBudgetBytes of sample data in memory (least recently used goes
+    // first); without it the budget only covers synthesised frets
+    bool lazyLoading = false;
+    size_t residentBudgetBytes = 8 * 1024 * 1024;
+
+    // frets on either side of a played one that get loaded in the background
+    int prefetchRadius = 2;
+
+    // keep only every anchorInterval-th recorded fret and synthesise the rest
+    // by pitch shifting the nearest anchor; 0 uses every recording
+    int anchorInterval = 0;
+
+    // also convert every sample to aligned planar float32 on load, the
+    // layout in-process mixing reads
+    bool planarFloat = false;
+
+    // drop the tail of each sample once its RMS stays below tailThresholdDb
+    // (dBFS), so the memory is freed and voices end sooner
+    bool trimTails = true;
+    float tailThresholdDb = -60.0f;
+
+    // play uncompressed bank samples from disk: only the first streamHeadMs
+    // of each stays resident and the rest is read ahead on an I/O thread;
+    // tail trimming and planarFloat only cover the resident head
+    bool streamFromDisk = false;
+    int streamHeadMs = 50;
+
+    // one voice per string, like a real guitar: a new note releases the one
+    // still ringing on its string
+    bool monophonic = true;
+
+    // slideNote glides the note sounding on its string to the new fret over
+    // slideMs instead of plucking again, so a slide is one voice; off, or
+    // with synthesised notes, it plays every fret like playNote
+    bool legatoSlides = true;
+    int slideMs = 30;
+
+    // at most maxVoices (up to Mixer::MAX_VOICES) notes sound at once; a new
+    // one beyond that releases a victim chosen by stealPolicy. The quietest
+    // is judged by the tail envelope, so without trimTails it is the oldest;
+    // a synthesised string is judged by its current level
+    int maxVoices = 24;
+    VoiceSteal stealPolicy = VoiceSteal::Quietest;
+
+    // every way a voice is stopped early ramps it to silence over releaseMs
+    // instead of cutting it mid-waveform; it is reclaimed once silent
+    int releaseMs = 5;
+
+    // frames the audio thread renders at a time (up to Mixer::MAX_BLOCK_FRAMES)
+    // and blocks kept queued on the device (at least 2); on ALSA these are
+    // the period size and count. Smaller and fewer cut latency, at more
+    // overhead per second and less slack for dropouts
+    int blockFrames = (int)Mixer::BLOCK_FRAMES;
+    int outputBuffers = 4;
+};
+
+struct ResidencyStats
+{
+    unsigned long long faultMisses = 0; // playNote had to wait for its sample
+    unsigned long long prefetches = 0;
+    unsigned long long evictions = 0;
+    size_t residentBytes = 0;
+};
+
+struct StreamStats
+{
+    unsigned long long underruns = 0; // a voice ran dry before its stream ended
+    unsigned long long readErrors = 0;
+    uint64_t bytesStreamed = 0;
+};
+
+struct RenderStats
+{
+    unsigned long long blocks = 0;
+    double averageLoad = 0.0;         // time spent rendering over the audio it produced
+    double worstLoad = 0.0;
+    double worstMs = 0.0;
+    unsigned long long late = 0;      // blocks that took longer than they play for
+    unsigned long long xruns = 0;     // the device ran out of audio
+    unsigned long long violations = 0; // RealtimeGuard reports, debug builds only
+};
+
+struct CommandStats
+{
+    unsigned long long commands = 0;  // queued for the audio thread
+    unsigned long long overflows = 0; // dropped because the queue was full
+    int peakDepth = 0;
+};
+
+struct VoiceStats
+{
+    int peakVoices = 0;
+    double averageVoices = 0.0;       // per rendered block
+    unsigned long long takeovers = 0; // faded out by a new note on their string
+    unsigned long long steals = 0;    // faded out by the polyphony cap
+    unsigned long long cuts = 0;      // silenced to free a slot, with nothing releasing to wait for
+    unsigned long long slides = 0;    // frets reached by gliding a sounding voice
+
+    // voices that played to their end or to the end of their release, and
+    // how long they sounded, in seconds
+    unsigned long long ended = 0;
+    double averageLifetime = 0.0;
+    double longestLifetime = 0.0;
+};
+
+struct TailStats
+{
+    size_t bytesDropped = 0;         // inaudible tails cut off at load
+    unsigned long long notes = 0;
+    double voiceSeconds = 0.0;       // summed length of the buffers played
+    double untrimmedSeconds = 0.0;   // the same without trimming
+};
 
 class AudioEngine
 {
 public:
-    static bool init();
+    static bool init(const AudioConfig& config = AudioConfig());
     static void shutdown();
 
-    static void collectGarbage();
+    // note commands are queued for the audio thread, which owns the voices
+    // and picks them up at the start of its next block; none of these block.
+    // stopAllNotes bypasses the queue, so it always gets through, and is
+    // silent releaseMs into the next block whatever the voice count
     static void playNote(std::string stringName, int fretIndex, float volume = 1.0f);
+    static void stopNotes(std::string stringName);
+
+    // starts the note on exactly frame `frame` of the output clock; a frame
+    // already rendered means as soon as possible. Stopping the string or all
+    // notes also cancels notes scheduled for later
+    static void playNoteAt(uint64_t frame, std::string stringName, int fretIndex, float volume = 1.0f);
+
+    // moves the note ringing on the string to a new fret, see legatoSlides;
+    // plays it at `volume` when the string is silent
+    static void slideNote(std::string stringName, int fretIndex, float volume = 1.0f);
+
     static void stopAllNotes();
+    static void setGain(float gain);
+
+    // releases the samples of voices the audio thread has finished with
+    static void collectGarbage();
+
+    // offline output only: renders the next `frames` frames of the virtual
+    // clock and reclaims finished voices; notes played afterwards start at
+    // exactly the new position
+    static void advance(uint64_t frames);
+
+    // the output clock, in frames rendered so far
+    static uint64_t clock();
+
+    // the output clock frame being rendered at time t, extrapolated from the
+    // latest block; the clock itself when rendering offline. Scheduling
+    // timestamped input at frameAt(t) plus a fixed lead of a block or two
+    // keeps its timing exact however the blocks fall
+    static uint64_t frameAt(std::chrono::steady_clock::time_point t);
+
+    // frets held by the current chord shape, -1 for muted strings; in lazy
+    // mode their samples get loaded before they are plucked
+    static void setChordShape(const std::array<int, 6>& frets);
+    static ResidencyStats residencyStats();
+    static TailStats tailStats();
+    static StreamStats streamStats();
+
+    // how close the audio thread runs to its deadline
+    static RenderStats renderStats();
+
+    // how long a note played now takes to be heard, in ms: up to a block
+    // until the audio thread picks it up, then every frame already queued
+    // on the device. Offline there is no device, so only the block counts
+    static double outputLatencyMs();
+    static CommandStats commandStats();
+    static VoiceStats voiceStats();
+
+    // packs every loose WAV under res/audio into a single sample bank file,
+    // optionally losslessly compressed
+    static bool packBank(const std::string& path = BANK_PATH, bool compress = false);
+
+    static constexpr const char* BANK_PATH = "res/audio.bank";
+
+    static constexpr int STRINGS = 6;
+    static constexpr int FRETS = 24;
+    static constexpr int RECORDED_FRETS = 21; // frets above are always synthesised
+
+    static const std::array<std::string, STRINGS> stringNames;
+    static std::string samplePath(int stringIndex, int fretIndex);
 
 private:
     struct Sound {
-        WAVEFORMATEX wfx{};
-        std::vector<BYTE> samples;
+        SampleBank::Format format{};
+        const uint8_t* data = nullptr;
+        uint32_t size = 0;
+        std::vector<uint8_t> samples; // file image backing data when not played from the bank
+        PlanarSamples planar;
+        std::vector<float> envelopeDb; // RMS per 10 ms window, empty unless trimTails
+        uint32_t untrimmedSize = 0;
+        const SampleBank::Entry* streamEntry = nullptr; // set when only the head above is resident
         bool loaded = false;
+
+        // residency, guarded by residencyMutex
+        bool loading = false;
+        bool failed = false;
+        bool queued = false; // waiting in prefetchQueue
+        int pins = 0;
+        std::list<int>::iterator lruPos;
     };
 
     struct Voice {
-        IXAudio2SourceVoice* voice = nullptr;
+        uint32_t mixerVoice = 0;
+        int stringIndex = 0;
+        int fretIndex = 0;
+        SampleStreamer::Stream* stream = nullptr; // the rest of a streamed sample
+        float gain = 1.0f;
+        const float* envelopeDb = nullptr;        // the sample's, to judge how loud it still is
+        uint32_t envelopeWindows = 0;
+        bool fading = false;                      // on its way out, no longer counts as sounding
+        uint64_t releaseFrame = 0;                // fading: output clock frame its release starts on
+        bool pinned = true;                       // holds its sample until collectGarbage releases it
+        bool replay = false;                      // a slide with nothing to glide, for the UI thread to play
+        uint32_t generation = 0;                  // replay: dropped if stopAllNotes came since
     };
 
-    static IXAudio2* xaudio;
-    static IXAudio2MasteringVoice* masterVoice;
+    struct Command {
+        // Slide pins no sample: it glides the note sounding on its string, or
+        // goes back to the UI thread to be played when there is none
+        enum class Type { Play, Slide, Stop, SetGain };
 
-    static std::vector<Voice> activeVoices;
+        Type type = Type::Play;
+        uint32_t generation = 0; // Play: stopAllGeneration when it was queued
+        uint64_t frame = 0; // Play: output clock frame to start on
+        uint32_t order = 0; // Play: breaks ties between notes scheduled for one frame
+        int stringIndex = 0;
+        int fretIndex = 0;
+        float gain = 1.0f;
+        Mixer::Source source;                     // Play: the pinned sample
+        SampleStreamer::Stream* stream = nullptr; // Play: opened by playNote
+        const float* envelopeDb = nullptr;        // Play
+        uint32_t envelopeWindows = 0;
+    };
 
-    static constexpr int STRINGS = 6;
-    static constexpr int FRETS = 21;
+    static constexpr int COMMAND_QUEUE_SIZE = 256;
+
+    static Mixer mixer;
+    static std::unique_ptr<AudioBackend> backend;
+    static OfflineBackend* offline; // backend, when rendering offline
+
+    // owned by the audio thread
+    static VoicePool<Voice, Mixer::MAX_VOICES> activeVoices;
+
+    // UI thread to audio thread, and back with the voices it is done with;
+    // every queued note comes back exactly once, so keeping at most
+    // retiredVoices.capacity() of them in flight means the return never fills
+    static SpscQueue<Command, COMMAND_QUEUE_SIZE> commands;
+    static SpscQueue<Voice, COMMAND_QUEUE_SIZE * 2> retiredVoices;
+    static int notesInFlight;
+    static CommandStats queueStats;
+
+    // bumped by stopAllNotes; the audio thread releases everything when it
+    // changes and drops notes queued before the change
+    static std::atomic<uint32_t> stopAllGeneration;
+    static uint32_t stoppedGeneration;
+
+    // audio thread: notes waiting for a later block, a min-heap on frame;
+    // every one is in flight, so it cannot overflow either
+    static std::array<Command, COMMAND_QUEUE_SIZE * 2> scheduled;
+    static int scheduledCount;
+    static uint32_t scheduleOrder;
+
+    // the clock and the time at the start of the latest block, published by
+    // the audio thread under a sequence count that is odd while it writes
+    static std::atomic<uint32_t> stampSequence;
+    static std::atomic<uint64_t> stampFrame;
+    static std::atomic<int64_t> stampNanos;
+
+    // written by the audio thread only
+    static std::atomic<int> peakVoices;
+    static std::atomic<unsigned long long> voiceBlocks;
+    static std::atomic<unsigned long long> voiceBlockSum;
+    static std::atomic<unsigned long long> takeovers;
+    static std::atomic<unsigned long long> steals;
+    static std::atomic<unsigned long long> cuts;
+    static std::atomic<unsigned long long> slides;
+    static std::atomic<unsigned long long> endedVoices;
+    static std::atomic<unsigned long long> lifetimeFrames;
+    static std::atomic<unsigned long long> longestLifetime;
+
+    // audio thread: the string model behind each synthesised voice, by slot
+    static KarplusStrong synthVoices[Mixer::MAX_VOICES];
+    static uint32_t plucks;
+
+    // audio thread: all six strings in one mixer voice, for StringBank
+    static StringBank stringBank;
+
+    // on the output when impulseResponsePath is set
+    static Convolver convolver;
 
     static Sound cachedSounds[STRINGS][FRETS];
 
-    static const std::array<std::string, STRINGS> stringNames;
+    static SampleBank bank;
+    static SampleStreamer streamer;
+    static AudioConfig config;
+
+    static std::mutex residencyMutex;
+    static std::condition_variable residencyChanged;
+    static std::list<int> lru; // sample ids, most recently used first
+    static size_t lruBytes;
+    static ResidencyStats stats;
+    static TailStats trimStats;
+
+    static std::thread prefetchThread;
+    static std::condition_variable prefetchWake;
+    static std::array<int, STRINGS * FRETS> prefetchQueue; // ring, a sample is queued at most once
+    static int prefetchHead;
+    static int prefetchCount;
+    static bool prefetchStop;
+    static std::array<int, STRINGS> chordShape;
+
+    static const char* loadWav(const std::string& path, Sound& out);
+    static const char* loadFromBank(int stringIndex, int fretIndex, Sound& out);
+    static const char* loadLooseWav(int stringIndex, int fretIndex, Sound& out);
+    static const char* validateSound(const Sound& snd);
+    static int loadSamples(int threads, bool fromBank);
+    static const char* loadSample(int stringIndex, int fretIndex, Sound& out);
+    static const char* synthesizeSound(int stringIndex, int fretIndex, Sound& out);
+    static bool isAnchor(int fretIndex);
+    static void trimTail(Sound& snd);
+    static void preparePlanar(Sound& snd);
+    static size_t residentSize(const Sound& snd);
+    static int anchorFor(int fretIndex);
+
+    static bool acquireSound(int stringIndex, int fretIndex);
+    static void releaseSound(int stringIndex, int fretIndex);
+    static void installSound(int id, Sound& loaded, const char* error);
+    static void evictSound(int id);
+    static void evictOverBudget();
+    static void requestPrefetch(int stringIndex, int fretIndex);
+    static void prefetchLoop();
 
-    static bool loadWav(const std::string& path, Sound& out);
+    static int stringIndexOf(const std::string& stringName);
+    static void queueNote(Command::Type type, uint64_t frame, const std::string& stringName, int fretIndex, float volume);
+    static bool sendCommand(const Command& cmd);
+    static void processCommands(void*);
+    static void applyStopAll(uint32_t generation);
+    static void startVoice(const Command& cmd, uint64_t now);
+    static void slideVoice(const Command& cmd);
+    static void retireCommand(const Command& cmd);
+    static void schedule(const Command& cmd);
+    static bool laterNote(const Command& a, const Command& b);
+    static void cancelScheduled(int stringIndex);
+    static void stampClock(uint64_t now);
+    static void retireVoice(int slot);
+    static void releaseVoice(int slot, uint32_t delay);
+    static int stealVictim();
+    static float voiceLevelDb(int slot);
+    static void voiceEnded(uint32_t voice, uint32_t slot, uint64_t played, void*);
 };
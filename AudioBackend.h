@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+
+class Mixer;
+
+// An audio output. It owns the device and pulls finished blocks from the
+// mixer whenever it needs more; it never sees individual voices.
+class AudioBackend
+{
+public:
+    virtual ~AudioBackend() = default;
+
+    virtual bool open(Mixer& mixer) = 0;
+    virtual void close() = 0;
+    virtual const char* name() const = 0;
+
+    // times the device ran out of audio to play
+    virtual unsigned long long xruns() const { return 0; }
+
+    // frames already handed to the device that have not been heard yet
+    virtual uint64_t queuedFrames() const { return 0; }
+};
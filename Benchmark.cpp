@@ -0,0 +1,1671 @@
+#include "Benchmark.h"
+#include "Audio.h"
+#include "WavParser.h"
+#include "SampleCodec.h"
+#include "PlanarSamples.h"
+#include "SampleBank.h"
+#include "SampleStreamer.h"
+#include "Mixer.h"
+#include "MixKernels.h"
+#include "SpscQueue.h"
+#include "KarplusStrong.h"
+#include "StringBank.h"
+#include "Convolver.h"
+#include "AlsaBackend.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <cstdio>
+#include <cmath>
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BENCHMARK_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& out)
+{
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) return false;
+
+    std::streamoff length = f.tellg();
+    if (length < 0) return false;
+    out.resize((size_t)length);
+    f.seekg(0);
+    f.read((char*)out.data(), out.size());
+    return (bool)f;
+}
+
+// reads a file past the OS cache, so what is timed is the disk; `cold` is
+// cleared if the cache could not be left out
+static bool readFileCold(const std::string& path, std::vector<uint8_t>& out, bool& cold)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    // unbuffered reads go to page-aligned memory in whole sectors
+    const DWORD CHUNK = 1 << 20;
+    LARGE_INTEGER size;
+    void* buffer = VirtualAlloc(nullptr, CHUNK, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    bool ok = buffer && GetFileSizeEx(file, &size);
+    if (ok) out.resize((size_t)size.QuadPart);
+
+    for (size_t done = 0; ok && done < out.size(); )
+    {
+        DWORD got = 0;
+        ok = ReadFile(file, buffer, CHUNK, &got, nullptr) && got > 0;
+        size_t take = std::min((size_t)got, out.size() - done);
+        if (ok) memcpy(out.data() + done, buffer, take);
+        done += take;
+    }
+
+    if (buffer) VirtualFree(buffer, 0, MEM_RELEASE);
+    CloseHandle(file);
+    return ok;
+#else
+    // written back first, the cache cannot drop dirty pages
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    if (fdatasync(fd) != 0 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0) cold = false;
+    ::close(fd);
+    return readFile(path, out);
+#endif
+}
+
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes)
+{
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write((const char*)bytes.data(), bytes.size());
+    return (bool)f;
+}
+
+// reads every WAV of the res/audio tree, past the OS cache when given
+// `cold`, see readFileCold; returns the seconds it took
+static double readAllWavs(std::vector<std::vector<uint8_t>>& files, size_t& totalBytes, bool* cold = nullptr)
+{
+    totalBytes = 0;
+
+    auto start = Clock::now();
+    for (int s = 0; s < AudioEngine::STRINGS; s++)
+    {
+        for (int f = 0; f < AudioEngine::RECORDED_FRETS; f++)
+        {
+            std::vector<uint8_t> bytes;
+            bool read = cold ? readFileCold(AudioEngine::samplePath(s, f), bytes, *cold)
+                : readFile(AudioEngine::samplePath(s, f), bytes);
+            if (!read) {
+                std::cout << "Missing " << AudioEngine::samplePath(s, f) << std::endl;
+                continue;
+            }
+            totalBytes += bytes.size();
+            files.push_back(std::move(bytes));
+        }
+    }
+    return secondsSince(start);
+}
+
+static void putU16(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back((uint8_t)v);
+    out.push_back((uint8_t)(v >> 8));
+}
+
+static void putU32(std::vector<uint8_t>& out, uint32_t v)
+{
+    putU16(out, v & 0xFFFF);
+    putU16(out, v >> 16);
+}
+
+// a chunk with its header and, for an odd size, the pad byte after it
+static void putChunk(std::vector<uint8_t>& out, const char* id, const std::vector<uint8_t>& body, uint32_t declaredSize)
+{
+    out.insert(out.end(), id, id + 4);
+    putU32(out, declaredSize);
+    out.insert(out.end(), body.begin(), body.end());
+    if (body.size() & 1) out.push_back(0);
+}
+
+static std::vector<uint8_t> fmtChunk(uint16_t formatTag, uint16_t channels, uint16_t bitsPerSample, bool extensible)
+{
+    std::vector<uint8_t> body;
+    uint16_t blockAlign = (uint16_t)(channels * bitsPerSample / 8);
+    putU16(body, extensible ? WavInfo::FORMAT_EXTENSIBLE : formatTag);
+    putU16(body, channels);
+    putU32(body, Mixer::SAMPLE_RATE);
+    putU32(body, Mixer::SAMPLE_RATE * blockAlign);
+    putU16(body, blockAlign);
+    putU16(body, bitsPerSample);
+    if (extensible) {
+        putU16(body, 22);
+        putU16(body, bitsPerSample);
+        putU32(body, channels == 2 ? 0x3 : 0x4);
+        // the sub-format GUID: the format tag, then the fixed KSDATAFORMAT tail
+        static const uint8_t tail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+        putU16(body, formatTag);
+        body.insert(body.end(), tail, tail + 14);
+    }
+    return body;
+}
+
+// RIFF header with the right size around the given chunks
+static std::vector<uint8_t> riffFile(const std::vector<uint8_t>& chunks)
+{
+    std::vector<uint8_t> out;
+    const char* riff = "RIFF";
+    out.insert(out.end(), riff, riff + 4);
+    putU32(out, (uint32_t)chunks.size() + 4);
+    const char* wave = "WAVE";
+    out.insert(out.end(), wave, wave + 4);
+    out.insert(out.end(), chunks.begin(), chunks.end());
+    return out;
+}
+
+struct WavCase
+{
+    const char* name;
+    std::vector<uint8_t> file;
+    WavError error;
+    std::vector<float> frames; // expected interleaved, when it parses
+};
+
+// the error paths and the formats the shipped 16-bit samples never reach;
+// returns how many cases went wrong
+static int checkWavCases()
+{
+    std::vector<WavCase> cases;
+
+    std::vector<uint8_t> pcm16;
+    for (int16_t v : { 16384, -16384, 8192, -32768 }) putU16(pcm16, (uint16_t)v);
+    std::vector<float> pcm16Frames = { 0.5f, -0.5f, 0.25f, -1.0f };
+
+    std::vector<uint8_t> chunks;
+    putChunk(chunks, "fmt ", fmtChunk(WavInfo::FORMAT_PCM, 2, 16, false), 16);
+    putChunk(chunks, "data", pcm16, (uint32_t)pcm16.size());
+    std::vector<uint8_t> plain = riffFile(chunks);
+    cases.push_back({ "16-bit PCM", plain, WavError::None, pcm16Frames });
+
+    cases.push_back({ "header cut short", std::vector<uint8_t>(plain.begin(), plain.begin() + 10), WavError::TooShort, {} });
+    cases.push_back({ "fmt chunk cut short", std::vector<uint8_t>(plain.begin(), plain.begin() + 30), WavError::TruncatedChunk, {} });
+
+    // declares more data than there is, and ends mid-frame: the whole
+    // frames are kept
+    chunks.clear();
+    putChunk(chunks, "fmt ", fmtChunk(WavInfo::FORMAT_PCM, 2, 16, false), 16);
+    putChunk(chunks, "data", pcm16, 4096);
+    chunks.push_back(0x7F);
+    cases.push_back({ "data chunk cut short", riffFile(chunks), WavError::None, pcm16Frames });
+    cases.push_back({ "data chunk under a frame", std::vector<uint8_t>(plain.begin(), plain.begin() + 46), WavError::TruncatedChunk, {} });
+
+    chunks.clear();
+    putChunk(chunks, "data", pcm16, (uint32_t)pcm16.size());
+    cases.push_back({ "no fmt chunk", riffFile(chunks), WavError::MissingFmt, {} });
+
+    chunks.clear();
+    putChunk(chunks, "fmt ", fmtChunk(WavInfo::FORMAT_PCM, 2, 16, false), 16);
+    putChunk(chunks, "LIST", { 'I', 'N', 'F', 'O' }, 4);
+    cases.push_back({ "no data chunk", riffFile(chunks), WavError::MissingData, {} });
+
+    // a 3-byte chunk is followed by a pad byte that is not the next header
+    chunks.clear();
+    putChunk(chunks, "fmt ", fmtChunk(WavInfo::FORMAT_PCM, 2, 16, false), 16);
+    putChunk(chunks, "note", { 'a', 'b', 'c' }, 3);
+    putChunk(chunks, "data", pcm16, (uint32_t)pcm16.size());
+    cases.push_back({ "odd-sized chunk", riffFile(chunks), WavError::None, pcm16Frames });
+
+    chunks.clear();
+    putChunk(chunks, "fmt ", fmtChunk(WavInfo::FORMAT_PCM, 2, 16, true), 40);
+    putChunk(chunks, "data", pcm16, (uint32_t)pcm16.size());
+    cases.push_back({ "extensible 16-bit PCM", riffFile(chunks), WavError::None, pcm16Frames });
+
+    std::vector<uint8_t> pcm24;
+    for (int32_t v : { 0x400000, -0x400000, 0x200000, -0x800000 }) {
+        pcm24.push_back((uint8_t)v);
+        pcm24.push_back((uint8_t)(v >> 8));
+        pcm24.push_back((uint8_t)(v >> 16));
+    }
+    chunks.clear();
+    putChunk(chunks, "fmt ", fmtChunk(WavInfo::FORMAT_PCM, 2, 24, false), 16);
+    putChunk(chunks, "data", pcm24, (uint32_t)pcm24.size());
+    cases.push_back({ "24-bit PCM", riffFile(chunks), WavError::None, pcm16Frames });
+
+    std::vector<uint8_t> float32;
+    for (float v : { 0.75f, -0.125f, 1.0f, -1.0f }) {
+        uint32_t bits;
+        memcpy(&bits, &v, 4);
+        putU32(float32, bits);
+    }
+    chunks.clear();
+    putChunk(chunks, "fmt ", fmtChunk(WavInfo::FORMAT_IEEE_FLOAT, 2, 32, false), 16);
+    putChunk(chunks, "data", float32, (uint32_t)float32.size());
+    cases.push_back({ "float32", riffFile(chunks), WavError::None, { 0.75f, -0.125f, 1.0f, -1.0f } });
+
+    int failed = 0;
+    for (const WavCase& c : cases)
+    {
+        WavInfo info;
+        WavError error = parseWav(c.file.data(), c.file.size(), info);
+        bool ok = error == c.error;
+
+        if (ok && error == WavError::None) {
+            PlanarSamples planar;
+            uint32_t frames = (uint32_t)(info.dataSize / info.blockAlign);
+            ok = frames * info.channels == c.frames.size() &&
+                planar.convert(info.data, frames, info.channels, info.bitsPerSample,
+                    info.formatTag == WavInfo::FORMAT_IEEE_FLOAT);
+            for (uint32_t i = 0; ok && i < frames; i++)
+                for (int ch = 0; ch < info.channels; ch++)
+                    ok = ok && planar.channel(ch)[i] == c.frames[i * info.channels + ch];
+        }
+
+        if (!ok) {
+            std::cout << "wav: " << c.name << ": " << wavErrorString(error) << ", expected "
+                << wavErrorString(c.error) << " - FAILED" << std::endl;
+            failed++;
+        }
+    }
+
+    std::cout << "wav: " << cases.size() - failed << " of " << cases.size()
+        << " hand-built files parsed as expected" << (failed ? " - FAILED" : "") << std::endl;
+    return failed;
+}
+
+// chunk walking throughput of the WAV parser over the whole res/audio tree,
+// and its handling of the files those never exercise
+static int benchWavParser()
+{
+    std::vector<std::vector<uint8_t>> files;
+    size_t totalBytes = 0;
+    bool cold = true;
+    double readSeconds = readAllWavs(files, totalBytes, &cold);
+
+    if (files.empty()) return -1;
+
+    int errors = 0;
+    size_t dataBytes = 0;
+    for (const auto& file : files)
+    {
+        WavInfo info;
+        if (parseWav(file.data(), file.size(), info) != WavError::None) errors++;
+        dataBytes += info.dataSize;
+    }
+
+    // repeat until at least a second has been measured
+    long long parses = 0;
+    auto parseStart = Clock::now();
+    double parseSeconds = 0.0;
+    do {
+        for (const auto& file : files)
+        {
+            WavInfo info;
+            parseWav(file.data(), file.size(), info);
+            parses++;
+        }
+        parseSeconds = secondsSince(parseStart);
+    } while (parseSeconds < 1.0);
+
+    double mb = totalBytes / (1024.0 * 1024.0);
+    double rounds = (double)parses / files.size();
+
+    std::cout << "wav: " << files.size() << " files, " << mb << " MB ("
+        << dataBytes / (1024.0 * 1024.0) << " MB sample data), " << errors << " parse errors" << std::endl;
+    std::cout << "wav: read " << (cold ? "from disk, past the OS cache, " : "(the OS cache could not be left out) ")
+        << mb / readSeconds << " MB/s" << std::endl;
+    std::cout << "wav: parse " << parseSeconds * 1e9 / parses << " ns/file, "
+        << mb * rounds / parseSeconds << " MB/s" << std::endl;
+
+    int failed = checkWavCases();
+
+    return errors == 0 && failed == 0 ? 0 : -1;
+}
+
+// compression ratio and decode throughput of the compressed bank codec
+static int benchCodec()
+{
+    std::vector<std::vector<uint8_t>> files;
+    size_t totalBytes = 0;
+    readAllWavs(files, totalBytes);
+
+    std::vector<WavInfo> infos;
+    std::vector<std::vector<uint8_t>> encoded;
+    size_t rawBytes = 0;
+    size_t packedBytes = 0;
+
+    auto encodeStart = Clock::now();
+    for (const auto& file : files)
+    {
+        WavInfo info;
+        if (parseWav(file.data(), file.size(), info) != WavError::None ||
+            info.formatTag != WavInfo::FORMAT_PCM || info.bitsPerSample != 16)
+            continue;
+
+        encoded.push_back(SampleCodec::encode((const int16_t*)info.data,
+            (uint32_t)(info.dataSize / info.blockAlign), info.channels));
+        infos.push_back(info);
+        rawBytes += info.dataSize;
+        packedBytes += encoded.back().size();
+    }
+    double encodeSeconds = secondsSince(encodeStart);
+
+    if (encoded.empty()) return -1;
+
+    std::vector<int16_t> out;
+    int mismatches = 0;
+    size_t largest = 0;
+    for (size_t i = 0; i < encoded.size(); i++)
+    {
+        out.assign(infos[i].dataSize / 2, 0);
+        if (!SampleCodec::decode(encoded[i].data(), encoded[i].size(), out.data()) ||
+            memcmp(out.data(), infos[i].data, infos[i].dataSize) != 0)
+            mismatches++;
+        largest = std::max(largest, out.size());
+    }
+    out.resize(largest);
+
+    double mb = rawBytes / (1024.0 * 1024.0);
+    std::cout << "codec: " << encoded.size() << " samples, " << mb << " MB -> "
+        << packedBytes / (1024.0 * 1024.0) << " MB, ratio " << (double)rawBytes / packedBytes
+        << ", " << mismatches << " mismatches" << std::endl;
+    std::cout << "codec: encode " << mb / encodeSeconds << " MB/s" << std::endl;
+
+    for (int simd = 0; simd < 2; simd++)
+    {
+        int rounds = 0;
+        auto start = Clock::now();
+        double seconds = 0.0;
+        do {
+            for (size_t i = 0; i < encoded.size(); i++)
+                SampleCodec::decode(encoded[i].data(), encoded[i].size(), out.data(), simd != 0);
+            rounds++;
+            seconds = secondsSince(start);
+        } while (seconds < 1.0);
+
+        std::cout << "codec: decode (" << (simd ? "SSE2" : "scalar") << ") "
+            << mb * rounds / seconds << " MB/s of PCM" << std::endl;
+    }
+
+    // a full load of every sample from the disk, as one file each way: the
+    // raw PCM is only read, the compressed samples are read and decoded
+    std::vector<uint8_t> rawBank, packedBank;
+    for (size_t i = 0; i < encoded.size(); i++)
+    {
+        rawBank.insert(rawBank.end(), infos[i].data, infos[i].data + infos[i].dataSize);
+        packedBank.insert(packedBank.end(), encoded[i].begin(), encoded[i].end());
+    }
+
+    const char* rawPath = "codec-bench-raw.bin";
+    const char* packedPath = "codec-bench-packed.bin";
+    if (!writeFile(rawPath, rawBank) || !writeFile(packedPath, packedBank)) return -1;
+
+    bool cold = true;
+    std::vector<uint8_t> bytes;
+    auto start = Clock::now();
+    bool read = readFileCold(rawPath, bytes, cold);
+    double rawSeconds = secondsSince(start);
+
+    start = Clock::now();
+    read = readFileCold(packedPath, bytes, cold) && read;
+    for (size_t i = 0, at = 0; read && i < encoded.size(); at += encoded[i++].size())
+        SampleCodec::decode(bytes.data() + at, encoded[i].size(), out.data());
+    double packedSeconds = secondsSince(start);
+
+    std::remove(rawPath);
+    std::remove(packedPath);
+    if (!read) return -1;
+
+    std::cout << "codec: full load " << (cold ? "from disk, past the OS cache" : "(the OS cache could not be left out)")
+        << ", raw " << rawSeconds * 1000.0 << " ms (" << mb / rawSeconds << " MB/s), compressed read and decoded "
+        << packedSeconds * 1000.0 << " ms (" << mb / packedSeconds << " MB/s of PCM), "
+        << rawSeconds / packedSeconds << "x the speed of raw" << std::endl;
+
+    return mismatches == 0 ? 0 : -1;
+}
+
+static void mixInt16Interleaved(const int16_t* src, uint32_t frames, float gain, float* left, float* right)
+{
+    const float scale = gain / 32768.0f;
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        left[i] += src[2 * i] * scale;
+        right[i] += src[2 * i + 1] * scale;
+    }
+}
+
+static void mixPlanarFloat(const float* srcLeft, const float* srcRight, uint32_t frames, float gain,
+    float* left, float* right)
+{
+    uint32_t i = 0;
+#ifdef BENCHMARK_SSE2
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 4 <= frames; i += 4)
+    {
+        _mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), _mm_mul_ps(g, _mm_loadu_ps(srcLeft + i))));
+        _mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), _mm_mul_ps(g, _mm_loadu_ps(srcRight + i))));
+    }
+#endif
+    for (; i < frames; i++)
+    {
+        left[i] += srcLeft[i] * gain;
+        right[i] += srcRight[i] * gain;
+    }
+}
+
+// per-block cost of mixing voices from int16 interleaved vs planar float32
+static int benchMixFormats()
+{
+    const uint32_t sampleFrames = 66150;
+    const int voices = 32;
+
+    std::mt19937 rng(1);
+    std::vector<int16_t> interleaved(sampleFrames * 2);
+    for (auto& v : interleaved) v = (int16_t)(rng() & 0xFFFF);
+
+    PlanarSamples planar;
+    planar.convert((const uint8_t*)interleaved.data(), sampleFrames, 2, 16, false);
+
+    // conversion kernel throughput
+    std::vector<float> outLeft(sampleFrames), outRight(sampleFrames);
+    float* outs[2] = { outLeft.data(), outRight.data() };
+    for (int simd = 0; simd < 2; simd++)
+    {
+        int rounds = 0;
+        auto start = Clock::now();
+        double seconds = 0.0;
+        do {
+            PlanarSamples::int16ToPlanar(interleaved.data(), sampleFrames, 2, outs, simd != 0);
+            rounds++;
+            seconds = secondsSince(start);
+        } while (seconds < 0.5);
+
+        std::cout << "mix: int16 -> planar float conversion (" << (simd ? "SSE2" : "scalar") << ") "
+            << sampleFrames * 4.0 * rounds / seconds / (1024.0 * 1024.0) << " MB/s of int16" << std::endl;
+    }
+
+    const uint32_t blockSizes[] = { 64, 256, 1024 };
+    for (uint32_t block : blockSizes)
+    {
+        std::vector<float> left(block), right(block);
+        uint32_t positions[voices];
+        for (int v = 0; v < voices; v++) positions[v] = (uint32_t)(rng() % (sampleFrames - block));
+
+        double nsPerVoiceBlock[2];
+        for (int planarPath = 0; planarPath < 2; planarPath++)
+        {
+            long long blocks = 0;
+            auto start = Clock::now();
+            double seconds = 0.0;
+            do {
+                for (int v = 0; v < voices; v++)
+                {
+                    uint32_t pos = positions[v];
+                    if (planarPath)
+                        mixPlanarFloat(planar.channel(0) + pos, planar.channel(1) + pos, block, 0.5f,
+                            left.data(), right.data());
+                    else
+                        mixInt16Interleaved(interleaved.data() + 2 * pos, block, 0.5f, left.data(), right.data());
+                }
+                blocks++;
+                seconds = secondsSince(start);
+            } while (seconds < 0.5);
+
+            nsPerVoiceBlock[planarPath] = seconds * 1e9 / (blocks * voices);
+        }
+
+        std::cout << "mix: block " << block << ", " << voices << " voices: int16 interleaved "
+            << nsPerVoiceBlock[0] << " ns/voice, planar float " << nsPerVoiceBlock[1]
+            << " ns/voice (" << nsPerVoiceBlock[0] / nsPerVoiceBlock[1] << "x)" << std::endl;
+    }
+
+    return 0;
+}
+
+// sweeps the mixing kernels of every ISA this CPU runs over voice counts and
+// block sizes, every voice ramping its gain; each has to stay within
+// MixKernels::TOLERANCE per voice of the scalar reference
+static int benchKernels()
+{
+    const uint32_t sampleFrames = 8192;
+    const int voiceCounts[] = { 1, 4, 16, 64, 256 };
+    const uint32_t blockSizes[] = { 32, 64, 128, 256, 512, 1024 };
+    const MixKernels::Isa isas[] = { MixKernels::Isa::Scalar, MixKernels::Isa::SSE2,
+        MixKernels::Isa::AVX2, MixKernels::Isa::NEON };
+
+    std::mt19937 rng(1);
+    std::vector<int16_t> interleaved(sampleFrames * 2);
+    for (auto& v : interleaved) v = (int16_t)(rng() & 0xFFFF);
+
+    PlanarSamples planar;
+    planar.convert((const uint8_t*)interleaved.data(), sampleFrames, 2, 16, false);
+
+    const int maxVoices = 256;
+    uint32_t offsets[maxVoices];
+    float gains[maxVoices], steps[maxVoices];
+    for (int v = 0; v < maxVoices; v++)
+    {
+        offsets[v] = (uint32_t)(rng() % (sampleFrames - 1024));
+        gains[v] = (rng() % 1000) / 1000.0f;
+        steps[v] = ((int)(rng() % 2001) - 1000) / 1e6f;
+    }
+
+    const MixKernels& reference = *MixKernels::get(MixKernels::Isa::Scalar);
+    std::cout << "kernels: " << MixKernels::best().name << " picked for this CPU" << std::endl;
+
+    int failures = 0;
+    for (int format = 0; format < 3; format++)
+    {
+        const char* formatName = format == 0 ? "int16 stereo" : format == 1 ? "int16 mono" : "planar float";
+
+        auto mix = [&](const MixKernels& k, int voices, uint32_t block, float* bus) {
+            for (int v = 0; v < voices; v++)
+            {
+                uint32_t at = offsets[v];
+                if (format == 0) k.int16Stereo((const uint8_t*)(interleaved.data() + 2 * at), block, gains[v], steps[v], bus);
+                else if (format == 1) k.int16Mono((const uint8_t*)(interleaved.data() + at), block, gains[v], steps[v], bus);
+                else k.planar(planar.channel(0) + at, planar.channel(1) + at, block, gains[v], steps[v], bus);
+            }
+        };
+
+        for (MixKernels::Isa isa : isas)
+        {
+            const MixKernels* k = MixKernels::get(isa);
+            if (!k) continue;
+
+            for (int voices : voiceCounts)
+            {
+                std::cout << "kernels: " << formatName << ", " << k->name << ", " << voices << " voices, us/block:";
+                double worstError = 0.0;
+
+                for (uint32_t block : blockSizes)
+                {
+                    std::vector<float> bus(block * 2, 0.0f), expected(block * 2, 0.0f);
+                    mix(reference, voices, block, expected.data());
+                    mix(*k, voices, block, bus.data());
+                    for (size_t i = 0; i < bus.size(); i++)
+                        worstError = std::max(worstError, (double)std::fabs(bus[i] - expected[i]));
+                    if (worstError > MixKernels::TOLERANCE * voices) failures++;
+
+                    long long blocks = 0;
+                    auto start = Clock::now();
+                    double seconds = 0.0;
+                    do {
+                        mix(*k, voices, block, bus.data());
+                        blocks++;
+                        seconds = secondsSince(start);
+                    } while (seconds < 0.02);
+
+                    std::cout << " " << block << "=" << seconds * 1e6 / blocks;
+                }
+
+                std::cout << ", max error " << worstError << std::endl;
+            }
+        }
+    }
+
+    if (failures)
+        std::cout << "kernels: " << failures << " results outside the tolerance" << std::endl;
+    return failures == 0 ? 0 : -1;
+}
+
+// streams a synthetic ~2 GB bank of velocity layers and round robins with
+// many voices pulling at the real-time rate, counting ring underruns
+static int benchStreaming()
+{
+    const char* path = "stream-bench.bank";
+    const int layers = 16; // 8 velocity layers x 2 round robins
+    const uint32_t rate = 44100;
+    const uint32_t sampleFrames = rate * 11 / 2;
+    const uint32_t blockFrames = rate / 100;
+    const uint32_t frameBytes = 4;
+    const uint32_t headFrames = rate / 20; // resident, as with AudioConfig::streamHeadMs = 50
+    const int distinct = 8;
+
+    // a few distinct decaying tones, shared by all entries so generating stays cheap
+    std::vector<std::vector<int16_t>> tones(distinct, std::vector<int16_t>(sampleFrames * 2));
+    for (int t = 0; t < distinct; t++)
+    {
+        for (uint32_t i = 0; i < sampleFrames; i++)
+        {
+            double v = std::sin(2.0 * 3.14159265358979 * (110.0 + 55.0 * t) * i / rate) * std::exp(-(double)i / rate);
+            tones[t][2 * i] = tones[t][2 * i + 1] = (int16_t)(v * 20000.0);
+        }
+    }
+
+    std::vector<SampleBank::Entry> entries;
+    std::vector<const uint8_t*> blobs;
+    for (int s = 0; s < AudioEngine::STRINGS; s++)
+    {
+        for (int f = 0; f < AudioEngine::FRETS; f++)
+        {
+            for (int l = 0; l < layers; l++)
+            {
+                SampleBank::Entry e{};
+                e.stringIndex = (uint16_t)s;
+                e.fretIndex = (uint16_t)f;
+                e.layer = (uint16_t)l;
+                e.format = { 1, 2, 16, (uint16_t)frameBytes, rate, rate * frameBytes };
+                e.size = (uint64_t)sampleFrames * frameBytes;
+                entries.push_back(e);
+                blobs.push_back((const uint8_t*)tones[entries.size() % distinct].data());
+            }
+        }
+    }
+
+    auto genStart = Clock::now();
+    if (!SampleBank::write(path, entries, blobs)) {
+        std::cout << "stream: could not write " << path << std::endl;
+        return -1;
+    }
+
+    SampleBank bank;
+    if (!bank.open(path, false)) {
+        std::cout << "stream: could not open " << path << std::endl;
+        std::remove(path);
+        return -1;
+    }
+
+    double bankGB = entries.size() * (double)sampleFrames * frameBytes / (1024.0 * 1024.0 * 1024.0);
+    std::cout << "stream: generated " << bankGB << " GB bank (" << entries.size() << " samples) in "
+        << secondsSince(genStart) << " s; it may still sit in the OS file cache" << std::endl;
+
+    SampleStreamer streamer;
+    streamer.start(bank, 1024);
+    std::mt19937 rng(1);
+
+    struct Player {
+        SampleStreamer::Stream* stream = nullptr;
+        SampleStreamer::Chunk chunk{};
+        uint32_t chunkPos = 0;
+        bool haveChunk = false;
+        uint32_t headLeft = 0;
+    };
+
+    const int voiceCounts[] = { 64, 256, 1024 };
+    for (int voices : voiceCounts)
+    {
+        std::vector<Player> players(voices);
+        unsigned long long underruns = 0;
+        uint64_t readBefore = streamer.bytesRead();
+
+        auto restart = [&](Player& p) {
+            streamer.close(p.stream);
+            const SampleBank::Entry& e = bank.entries()[rng() % bank.entries().size()];
+            p.stream = streamer.open(e, (uint64_t)headFrames * frameBytes);
+            p.haveChunk = false;
+            p.headLeft = headFrames;
+        };
+        for (auto& p : players) restart(p);
+
+        const double seconds = 5.0;
+        const long long blocks = (long long)(seconds * rate / blockFrames);
+        auto start = Clock::now();
+
+        for (long long b = 0; b < blocks; b++)
+        {
+            for (auto& p : players)
+            {
+                uint32_t need = blockFrames;
+                uint32_t fromHead = std::min(need, p.headLeft);
+                p.headLeft -= fromHead;
+                need -= fromHead;
+
+                while (need > 0)
+                {
+                    if (!p.haveChunk) {
+                        if (streamer.finished(p.stream)) {
+                            restart(p);
+                            break;
+                        }
+                        if (!streamer.next(p.stream, p.chunk)) {
+                            underruns++;
+                            break;
+                        }
+                        p.haveChunk = true;
+                        p.chunkPos = 0;
+                    }
+
+                    uint32_t take = std::min(need, (p.chunk.bytes - p.chunkPos) / frameBytes);
+                    p.chunkPos += take * frameBytes;
+                    need -= take;
+
+                    if (p.chunkPos >= p.chunk.bytes) {
+                        streamer.release(p.stream);
+                        p.haveChunk = false;
+                    }
+                }
+            }
+
+            // pull at the real-time rate
+            std::this_thread::sleep_until(start + std::chrono::microseconds((b + 1) * 1000000LL * blockFrames / rate));
+        }
+
+        double elapsed = secondsSince(start);
+        for (auto& p : players) streamer.close(p.stream);
+
+        std::cout << "stream: " << voices << " voices for " << seconds << " s: "
+            << (streamer.bytesRead() - readBefore) / elapsed / (1024.0 * 1024.0) << " MB/s read, "
+            << underruns << " underruns in " << blocks * voices << " voice blocks" << std::endl;
+    }
+
+    streamer.stop();
+    bank.close();
+    std::remove(path);
+    return streamer.readErrors() == 0 ? 0 : -1;
+}
+
+// mixes a fixed sequence of real notes through the software mixer twice;
+// both renders have to match bit for bit
+static int benchRender()
+{
+    std::vector<std::vector<uint8_t>> files;
+    size_t totalBytes = 0;
+    readAllWavs(files, totalBytes);
+    if (files.empty()) return -1;
+
+    std::vector<Mixer::Source> sources;
+    for (const auto& file : files)
+    {
+        WavInfo info;
+        if (parseWav(file.data(), file.size(), info) != WavError::None || info.formatTag != WavInfo::FORMAT_PCM ||
+            info.bitsPerSample != 16 || info.sampleRate != Mixer::SAMPLE_RATE)
+            continue;
+
+        Mixer::Source src;
+        src.data = info.data;
+        src.frames = (uint32_t)(info.dataSize / info.blockAlign);
+        src.channels = info.channels;
+        sources.push_back(src);
+    }
+    if (sources.empty()) return -1;
+
+    // a note every 20 blocks (~116 ms), cycling through the library
+    const int blocks = 20000;
+    auto render = [&](std::vector<float>& out, double& seconds) {
+        Mixer mixer;
+        std::vector<uint32_t> playing;
+        out.resize((size_t)blocks * Mixer::BLOCK_FRAMES * Mixer::CHANNELS);
+
+        auto start = Clock::now();
+        for (int b = 0; b < blocks; b++)
+        {
+            if (b % 20 == 0)
+                playing.push_back(mixer.play(sources[(b / 20) % sources.size()], 0.25f));
+
+            mixer.render(&out[(size_t)b * Mixer::BLOCK_FRAMES * Mixer::CHANNELS]);
+
+            for (size_t i = 0; i < playing.size(); )
+            {
+                if (mixer.finished(playing[i])) {
+                    mixer.remove(playing[i]);
+                    playing.erase(playing.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+        }
+        seconds = secondsSince(start);
+    };
+
+    std::vector<float> first, second;
+    double firstSeconds = 0.0, secondSeconds = 0.0;
+    render(first, firstSeconds);
+    render(second, secondSeconds);
+
+    bool identical = memcmp(first.data(), second.data(), first.size() * sizeof(float)) == 0;
+    double audioSeconds = (double)blocks * Mixer::BLOCK_FRAMES / Mixer::SAMPLE_RATE;
+
+    std::cout << "render: " << blocks << " blocks of " << Mixer::BLOCK_FRAMES << " frames, "
+        << std::min(firstSeconds, secondSeconds) * 1e6 / blocks << " us/block, "
+        << audioSeconds / std::min(firstSeconds, secondSeconds) << "x real time, output "
+        << (identical ? "identical" : "DIFFERS") << " across runs" << std::endl;
+
+    return identical ? 0 : -1;
+}
+
+// plays a minute of strummed chords through the whole engine on the offline
+// backend, discarding the output, once with every note ringing out and once
+// with one voice per string under the default polyphony cap
+static int benchOffline()
+{
+    for (int mono = 1; mono >= 0; mono--)
+    {
+        AudioConfig config;
+        config.output = AudioOutput::Offline;
+        if (!mono) {
+            config.monophonic = false;
+            config.maxVoices = Mixer::MAX_VOICES;
+        }
+        if (!AudioEngine::init(config)) return -1;
+
+        const uint64_t beat = Mixer::SAMPLE_RATE / 2;
+        const uint64_t spread = Mixer::SAMPLE_RATE / 100; // between the strings of a strum
+
+        auto start = Clock::now();
+        for (int b = 0; b < 120; b++)
+        {
+            for (int s = 0; s < AudioEngine::STRINGS; s++)
+            {
+                AudioEngine::playNote(AudioEngine::stringNames[s], (b + s) % AudioEngine::RECORDED_FRETS, 0.3f);
+                AudioEngine::advance(spread);
+            }
+            AudioEngine::advance(beat - AudioEngine::STRINGS * spread);
+        }
+        AudioEngine::advance(2 * Mixer::SAMPLE_RATE);
+        double seconds = secondsSince(start);
+
+        double audioSeconds = (double)AudioEngine::clock() / Mixer::SAMPLE_RATE;
+        VoiceStats vs = AudioEngine::voiceStats();
+        std::cout << "offline (" << (mono ? "one voice per string" : "every note rings out") << "): "
+            << audioSeconds << " s of audio rendered in " << seconds << " s, "
+            << audioSeconds / seconds << "x real time, " << vs.averageVoices << " voices on average, "
+            << vs.peakVoices << " at peak, " << vs.ended << " ended after " << vs.averageLifetime
+            << " s on average" << std::endl;
+
+        AudioEngine::shutdown();
+    }
+
+    return 0;
+}
+
+// the offline strumming run at block sizes from 64 to 2048 frames: the
+// audio thread's load against the latency each setting would have on a
+// device keeping 2 to 4 blocks queued
+static int benchLatency()
+{
+    const int sizes[] = { 64, 128, 256, 512, 1024, 2048 };
+
+    for (int size : sizes)
+    {
+        AudioConfig config;
+        config.output = AudioOutput::Offline;
+        config.monophonic = false;
+        config.maxVoices = Mixer::MAX_VOICES;
+        config.blockFrames = size;
+        if (!AudioEngine::init(config)) return -1;
+
+        const uint64_t beat = Mixer::SAMPLE_RATE / 2;
+        const uint64_t spread = Mixer::SAMPLE_RATE / 100;
+        for (int b = 0; b < 60; b++)
+        {
+            for (int s = 0; s < AudioEngine::STRINGS; s++)
+            {
+                AudioEngine::playNote(AudioEngine::stringNames[s], (b + s) % AudioEngine::RECORDED_FRETS, 0.3f);
+                AudioEngine::advance(spread);
+            }
+            AudioEngine::advance(beat - AudioEngine::STRINGS * spread);
+        }
+
+        RenderStats rs = AudioEngine::renderStats();
+        double blockMs = size * 1000.0 / Mixer::SAMPLE_RATE;
+        std::cout << "latency: " << size << "-frame blocks, load " << rs.averageLoad * 100.0 << "% on average, "
+            << rs.worstLoad * 100.0 << "% at worst; on a device "
+            << 3 * blockMs << " ms with 2 buffers, " << 4 * blockMs << " ms with 3, "
+            << 5 * blockMs << " ms with 4" << std::endl;
+
+        AudioEngine::shutdown();
+    }
+
+    return 0;
+}
+
+// 64 Karplus-Strong voices ringing at once for ten seconds straight through
+// the mixer, which has to take well under 5% of one core, then a strummed
+// run through the whole engine with synthesis in place of the samples
+static int benchSynth()
+{
+    const int voices = 64;
+    const int blocks = 10 * Mixer::SAMPLE_RATE / Mixer::BLOCK_FRAMES;
+    AudioConfig defaults;
+
+    static KarplusStrong strings[voices];
+    static Mixer mixer;
+    mixer.reset();
+    for (int v = 0; v < voices; v++)
+    {
+        StringModel model = defaults.strings[v % AudioEngine::STRINGS];
+        model.decaySeconds = 60.0f; // still ringing at the end
+        strings[v].pluck(model, v % AudioEngine::FRETS, v + 1);
+
+        Mixer::Source src;
+        src.generator = &strings[v];
+        mixer.play(src, 1.0f / voices);
+    }
+
+    std::vector<float> out(Mixer::BLOCK_FRAMES * Mixer::CHANNELS);
+    auto start = Clock::now();
+    for (int b = 0; b < blocks; b++)
+        mixer.render(out.data());
+    double seconds = secondsSince(start);
+
+    double load = seconds / ((double)blocks * Mixer::BLOCK_FRAMES / Mixer::SAMPLE_RATE);
+    bool fast = load < 0.05 && mixer.voiceCount() == (size_t)voices;
+    std::cout << "synth: " << voices << " voices, " << load * 100.0 << "% of one core, "
+        << seconds * 1e9 / ((double)blocks * Mixer::BLOCK_FRAMES * voices) << " ns per voice frame"
+        << (fast ? "" : " - FAILED") << std::endl;
+
+    AudioConfig config;
+    config.output = AudioOutput::Offline;
+    config.notes = NoteSource::Synthesis;
+    if (!AudioEngine::init(config)) return -1;
+
+    auto engineStart = Clock::now();
+    for (int b = 0; b < 40; b++)
+    {
+        for (int s = 0; s < AudioEngine::STRINGS; s++)
+        {
+            AudioEngine::playNote(AudioEngine::stringNames[s], (b + s) % AudioEngine::FRETS, 0.3f);
+            AudioEngine::advance(Mixer::SAMPLE_RATE / 100);
+        }
+        AudioEngine::advance(Mixer::SAMPLE_RATE / 2 - AudioEngine::STRINGS * Mixer::SAMPLE_RATE / 100);
+    }
+    AudioEngine::advance(5 * Mixer::SAMPLE_RATE);
+    double engineSeconds = secondsSince(engineStart);
+
+    VoiceStats vs = AudioEngine::voiceStats();
+    double audioSeconds = (double)AudioEngine::clock() / Mixer::SAMPLE_RATE;
+    AudioEngine::shutdown();
+
+    bool played = vs.ended == 240;
+    std::cout << "synth: strummed through the engine, " << audioSeconds / engineSeconds << "x real time, "
+        << vs.ended << " of 240 notes ended, " << vs.averageVoices << " voices on average"
+        << (played ? "" : " - FAILED") << std::endl;
+
+    return fast && played ? 0 : -1;
+}
+
+// all six strings ringing for ten seconds, as six KarplusStrong voices and
+// as one StringBank, then the bank's sympathetic resonance: how loud the
+// open D string gets while the A string plays the same D, against a
+// semitone below it, and that a bank coupled far too strongly still dies
+// away. The bank has to cost under half as much as the six voices
+static int benchBank()
+{
+    const int second = (int)(Mixer::SAMPLE_RATE / Mixer::BLOCK_FRAMES); // in blocks
+    const int blocks = 10 * second;
+    const int frets[StringBank::STRINGS] = { 3, 2, 0, 0, 3, 3 }; // a G chord
+    AudioConfig defaults;
+    std::array<StringModel, StringBank::STRINGS> ringing = defaults.strings;
+    for (StringModel& model : ringing)
+        model.decaySeconds = 60.0f;
+
+    std::vector<float> out(Mixer::BLOCK_FRAMES), voice(Mixer::BLOCK_FRAMES);
+    double scalarSeconds = 1e9, bankSeconds = 1e9;
+    float scalarSum = 0.0f, bankSum = 0.0f; // keeps the work from being optimised away
+
+    static KarplusStrong voices[StringBank::STRINGS];
+    static StringBank bank;
+    for (int pass = 0; pass < 3; pass++)
+    {
+        for (int s = 0; s < StringBank::STRINGS; s++)
+            voices[s].pluck(ringing[s], frets[s], s + 1);
+
+        auto start = Clock::now();
+        for (int b = 0; b < blocks; b++)
+        {
+            std::fill(out.begin(), out.end(), 0.0f);
+            for (int s = 0; s < StringBank::STRINGS; s++)
+            {
+                voices[s].generate(voice.data(), Mixer::BLOCK_FRAMES);
+                for (uint32_t i = 0; i < Mixer::BLOCK_FRAMES; i++)
+                    out[i] += voice[i];
+            }
+            scalarSum += out[0];
+        }
+        scalarSeconds = std::min(scalarSeconds, secondsSince(start));
+
+        bank.reset(ringing, StringBank::bridgeCoupling(defaults.bridgeCoupling));
+        for (int s = 0; s < StringBank::STRINGS; s++)
+            bank.pluck(s, frets[s], 1.0f, s + 1);
+
+        start = Clock::now();
+        for (int b = 0; b < blocks; b++)
+        {
+            bank.generate(out.data(), Mixer::BLOCK_FRAMES);
+            bankSum += out[0];
+        }
+        bankSeconds = std::min(bankSeconds, secondsSince(start));
+    }
+
+    double frames = (double)blocks * Mixer::BLOCK_FRAMES;
+    double perString = scalarSeconds / StringBank::STRINGS;
+    bool cheap = bankSeconds < 3.0 * perString; // half the six voices
+    std::cout << "bank: six strings for " << frames / Mixer::SAMPLE_RATE << " s, "
+        << scalarSeconds * 1e9 / frames << " ns/frame as six voices, "
+        << bankSeconds * 1e9 / frames << " ns/frame as one coupled bank ("
+        << bankSeconds / perString << "x one string)" << (cheap ? "" : " - FAILED")
+        << (std::isfinite(scalarSum + bankSum) ? "" : " - NOT FINITE") << std::endl;
+
+    // the open D string after two seconds of the A string at fret 5 and 4
+    auto sympathy = [&](int fret, float amount) {
+        bank.reset(defaults.strings, StringBank::bridgeCoupling(amount));
+        bank.pluck(1, fret, 1.0f, 1);
+        for (int b = 0; b < 2 * second; b++)
+            bank.generate(out.data(), Mixer::BLOCK_FRAMES);
+        return bank.levelDb(2) - bank.levelDb(1);
+    };
+    float unison = sympathy(5, defaults.bridgeCoupling);
+    float detuned = sympathy(4, defaults.bridgeCoupling);
+    sympathy(5, 0.0f);
+    bool silent = bank.levelDb(2) <= -120.0f;
+    bool resonates = unison > detuned + 6.0f && silent;
+    std::cout << "bank: open D relative to the A string after 2 s, " << unison << " dB in unison, "
+        << detuned << " dB a semitone off, " << (silent ? "silent" : "NOT silent") << " uncoupled"
+        << (resonates ? "" : " - FAILED") << std::endl;
+
+    // every string high up the neck, where the loops lose least per trip
+    bank.reset(defaults.strings, StringBank::bridgeCoupling(100.0f * defaults.bridgeCoupling));
+    for (int s = 0; s < StringBank::STRINGS; s++)
+        bank.pluck(s, AudioEngine::FRETS - 1, 1.0f, s + 1);
+    float loudest = -200.0f;
+    for (int b = 0; b < 20 * second; b++)
+        bank.generate(out.data(), Mixer::BLOCK_FRAMES);
+    for (int s = 0; s < StringBank::STRINGS; s++)
+        loudest = std::max(loudest, bank.levelDb(s));
+    bool stable = loudest < -60.0f;
+    std::cout << "bank: coupled 100 times over, the loudest string is at " << loudest << " dB after 20 s"
+        << (stable ? "" : " - FAILED") << std::endl;
+
+    // the same strumming as synth, through the engine
+    AudioConfig config;
+    config.output = AudioOutput::Offline;
+    config.notes = NoteSource::StringBank;
+    if (!AudioEngine::init(config)) return -1;
+
+    auto engineStart = Clock::now();
+    for (int b = 0; b < 40; b++)
+    {
+        for (int s = 0; s < AudioEngine::STRINGS; s++)
+        {
+            AudioEngine::playNote(AudioEngine::stringNames[s], (b + s) % AudioEngine::FRETS, 0.3f);
+            AudioEngine::advance(Mixer::SAMPLE_RATE / 100);
+        }
+        AudioEngine::advance(Mixer::SAMPLE_RATE / 2 - AudioEngine::STRINGS * Mixer::SAMPLE_RATE / 100);
+    }
+    AudioEngine::stopAllNotes();
+    AudioEngine::advance(Mixer::SAMPLE_RATE);
+    double engineSeconds = secondsSince(engineStart);
+
+    CommandStats cs = AudioEngine::commandStats();
+    double audioSeconds = (double)AudioEngine::clock() / Mixer::SAMPLE_RATE;
+    AudioEngine::shutdown();
+
+    bool played = cs.commands == 240 && cs.overflows == 0;
+    std::cout << "bank: strummed through the engine, " << audioSeconds / engineSeconds << "x real time, "
+        << cs.commands << " of 240 notes played" << (played ? "" : " - FAILED") << std::endl;
+
+    return cheap && resonates && stable && played ? 0 : -1;
+}
+
+// renders a run of notes at uneven frames to a WAV twice: once scheduled
+// all up front with playNoteAt, once advancing the clock to each note and
+// playing it then. Notes ring out (no monophony, no steals), so the two
+// renders have to be bit-identical
+static int benchSchedule()
+{
+    std::mt19937 rng(7);
+    struct Note { uint64_t frame; int string; int fret; };
+    std::vector<Note> notes;
+    uint64_t frame = 1000;
+    for (int n = 0; n < 200; n++)
+    {
+        frame += 2000 + rng() % 18000;
+        notes.push_back({ frame, (int)(rng() % AudioEngine::STRINGS), (int)(rng() % AudioEngine::RECORDED_FRETS) });
+    }
+    const uint64_t total = frame + 2 * Mixer::SAMPLE_RATE;
+
+    const char* paths[2] = { "schedule-bench-a.wav", "schedule-bench-b.wav" };
+    double seconds[2] = {};
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        AudioConfig config;
+        config.output = AudioOutput::Offline;
+        config.offlineWavPath = paths[pass];
+        config.monophonic = false;
+        config.maxVoices = Mixer::MAX_VOICES;
+        if (!AudioEngine::init(config)) return -1;
+
+        auto start = Clock::now();
+        if (pass == 0) {
+            for (const Note& n : notes)
+                AudioEngine::playNoteAt(n.frame, AudioEngine::stringNames[n.string], n.fret, 0.2f);
+        } else {
+            for (const Note& n : notes)
+            {
+                AudioEngine::advance(n.frame - AudioEngine::clock());
+                AudioEngine::playNote(AudioEngine::stringNames[n.string], n.fret, 0.2f);
+            }
+        }
+        AudioEngine::advance(total - AudioEngine::clock());
+        seconds[pass] = secondsSince(start);
+
+        AudioEngine::shutdown();
+    }
+
+    std::vector<uint8_t> a, b;
+    bool identical = readFile(paths[0], a) && readFile(paths[1], b) && !a.empty() && a == b;
+    std::remove(paths[0]);
+    std::remove(paths[1]);
+
+    std::cout << "schedule: " << notes.size() << " notes at uneven frames, scheduled up front in "
+        << seconds[0] << " s, played at each frame in " << seconds[1] << " s, output "
+        << (identical ? "identical" : "DIFFERS") << "; played unscheduled from a "
+        << Mixer::BLOCK_FRAMES << "-frame device they would land up to "
+        << Mixer::BLOCK_FRAMES * 1000.0 / Mixer::SAMPLE_RATE << " ms late" << std::endl;
+
+    return identical ? 0 : -1;
+}
+
+// starts 64 voices, stops them all mid-note and reads the render back: how
+// long the output takes to go silent after the stop, and the largest jump
+// between two samples from there on, once cut hard and once released
+static int benchStop()
+{
+    const char* path = "stop-bench.wav";
+    const uint64_t stopAt = Mixer::SAMPLE_RATE / 2;
+    const int releases[2] = { 0, AudioConfig().releaseMs };
+    double silentMs[2] = {}, worstStep[2] = {};
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        AudioConfig config;
+        config.output = AudioOutput::Offline;
+        config.offlineWavPath = path;
+        config.monophonic = false;
+        config.maxVoices = Mixer::MAX_VOICES;
+        config.releaseMs = releases[pass];
+        if (!AudioEngine::init(config)) return -1;
+
+        for (int n = 0; n < 64; n++)
+        {
+            AudioEngine::playNote(AudioEngine::stringNames[n % AudioEngine::STRINGS], n % AudioEngine::RECORDED_FRETS, 0.05f);
+            AudioEngine::advance(Mixer::SAMPLE_RATE / 400);
+        }
+        AudioEngine::advance(stopAt - AudioEngine::clock());
+        AudioEngine::stopAllNotes();
+        AudioEngine::advance(Mixer::SAMPLE_RATE / 5);
+        AudioEngine::shutdown();
+
+        std::vector<uint8_t> file;
+        WavInfo info;
+        if (!readFile(path, file) || parseWav(file.data(), file.size(), info) != WavError::None ||
+            info.formatTag != WavInfo::FORMAT_IEEE_FLOAT || info.channels != 2) {
+            std::cout << "stop: could not read back " << path << std::endl;
+            std::remove(path);
+            return -1;
+        }
+
+        std::vector<float> samples(info.dataSize / sizeof(float));
+        memcpy(samples.data(), info.data, samples.size() * sizeof(float));
+        std::remove(path);
+
+        size_t silentFrom = samples.size() / 2;
+        while (silentFrom > stopAt && samples[2 * silentFrom - 2] == 0.0f && samples[2 * silentFrom - 1] == 0.0f)
+            silentFrom--;
+        silentMs[pass] = (silentFrom - stopAt) * 1000.0 / Mixer::SAMPLE_RATE;
+
+        for (size_t i = 2 * stopAt; i < samples.size(); i++)
+            worstStep[pass] = std::max(worstStep[pass], (double)std::fabs(samples[i] - samples[i - 2]));
+    }
+
+    // with the cap at every slot the mixer has, a new note waits for a voice
+    // to finish releasing rather than cut one off: every note still plays
+    // and ends on its own
+    AudioConfig config;
+    config.output = AudioOutput::Offline;
+    config.monophonic = false;
+    config.maxVoices = Mixer::MAX_VOICES;
+    if (!AudioEngine::init(config)) return -1;
+
+    const int crowd = 2 * Mixer::MAX_VOICES;
+    for (int n = 0; n < crowd; n++)
+    {
+        AudioEngine::playNote(AudioEngine::stringNames[n % AudioEngine::STRINGS], n % AudioEngine::RECORDED_FRETS, 0.05f);
+        AudioEngine::advance(Mixer::SAMPLE_RATE / 400);
+    }
+    AudioEngine::advance(4 * Mixer::SAMPLE_RATE);
+    VoiceStats vs = AudioEngine::voiceStats();
+    AudioEngine::shutdown();
+
+    double allowedMs = releases[1] + Mixer::BLOCK_FRAMES * 1000.0 / Mixer::SAMPLE_RATE;
+    bool ok = silentMs[1] <= allowedMs && worstStep[1] < worstStep[0] && vs.cuts == 0 && vs.ended == (unsigned long long)crowd;
+
+    std::cout << "stop: 64 voices, silent " << silentMs[0] << " ms after stopAllNotes with a hard cut, "
+        << silentMs[1] << " ms with a " << releases[1] << " ms release (allowed " << allowedMs
+        << "), largest sample step " << worstStep[0] << " cut, " << worstStep[1] << " released" << std::endl;
+    std::cout << "stop: " << crowd << " notes on " << Mixer::MAX_VOICES << " voices, " << vs.steals << " stolen, "
+        << vs.cuts << " cut, " << vs.ended << " ended on their own" << (ok ? "" : " - FAILED") << std::endl;
+
+    return ok ? 0 : -1;
+}
+
+// a sine voice slid up ten frets a fret at a time, the way a right-click
+// drag does: it has to land on the tenth fret's pitch without a click on
+// the way, then the same slide through the engine, which with legato
+// slides has to play it as one voice instead of eleven. Also what a
+// gliding voice costs against one read straight through
+static int benchSlide()
+{
+    const float hz = 220.0f;
+    const uint32_t frames = 4 * Mixer::SAMPLE_RATE;
+    const float pi = 3.14159265f;
+    std::vector<int16_t> sine((size_t)frames * 2);
+    for (uint32_t i = 0; i < frames; i++)
+        sine[2 * i] = sine[2 * i + 1] = (int16_t)std::lround(16384.0 * std::sin(2.0 * pi * hz * i / Mixer::SAMPLE_RATE));
+
+    Mixer::Source src;
+    src.data = (const uint8_t*)sine.data();
+    src.frames = frames;
+    src.channels = 2;
+
+    static Mixer mixer;
+    mixer.reset();
+    uint32_t voice = mixer.play(src, 1.0f);
+
+    const uint32_t fretFrames = Mixer::SAMPLE_RATE / 20;
+    const int blocks = 40;
+    std::vector<float> out((size_t)blocks * 10 * Mixer::BLOCK_FRAMES * Mixer::CHANNELS);
+    for (int b = 0; b < blocks * 10; b++)
+    {
+        uint64_t at = mixer.clock();
+        if (at >= fretFrames && at / fretFrames <= 10 && (at - Mixer::BLOCK_FRAMES) / fretFrames != at / fretFrames)
+            mixer.glide(voice, std::pow(2.0f, (float)(at / fretFrames) / 12.0f), Mixer::SAMPLE_RATE * 30 / 1000);
+        mixer.render(&out[(size_t)b * Mixer::BLOCK_FRAMES * Mixer::CHANNELS]);
+    }
+
+    // rising zero crossings over the last second, interpolated
+    size_t total = out.size() / 2;
+    size_t from = total - Mixer::SAMPLE_RATE;
+    double first = -1.0, last = 0.0;
+    int crossings = 0;
+    for (size_t i = from + 1; i < total; i++)
+    {
+        float a = out[2 * i - 2], b = out[2 * i];
+        if (a < 0.0f && b >= 0.0f) {
+            double at = i - 1 + a / (a - b);
+            if (first < 0.0) first = at;
+            last = at;
+            crossings++;
+        }
+    }
+    double measured = (crossings - 1) * (double)Mixer::SAMPLE_RATE / (last - first);
+    double target = hz * std::pow(2.0, 10.0 / 12.0);
+
+    // the steepest a clean sine at the top pitch gets, with some room for
+    // the interpolation
+    double worstStep = 0.0;
+    for (size_t i = 1; i < total; i++)
+        worstStep = std::max(worstStep, (double)std::fabs(out[2 * i] - out[2 * i - 2]));
+    double allowedStep = 1.2 * 0.5 * 2.0 * pi * target / Mixer::SAMPLE_RATE;
+
+    bool pitched = std::fabs(measured / target - 1.0) < 0.002 && worstStep < allowedStep;
+    std::cout << "slide: ten frets up from " << hz << " Hz, settled at " << measured << " Hz (target "
+        << target << "), largest sample step " << worstStep << " (allowed " << allowedStep << ")"
+        << (pitched ? "" : " - FAILED") << std::endl;
+
+    // 32 voices read straight through, then gliding
+    double nanos[2] = {};
+    for (int glided = 0; glided < 2; glided++)
+    {
+        mixer.reset();
+        for (int v = 0; v < 32; v++)
+        {
+            uint32_t id = mixer.play(src, 1.0f / 32);
+            if (glided) mixer.glide(id, 1.0f + v / 64.0f, Mixer::SAMPLE_RATE);
+        }
+
+        const int runBlocks = 2 * Mixer::SAMPLE_RATE / Mixer::BLOCK_FRAMES;
+        auto start = Clock::now();
+        for (int b = 0; b < runBlocks; b++)
+            mixer.render(out.data());
+        nanos[glided] = secondsSince(start) * 1e9 / ((double)runBlocks * Mixer::BLOCK_FRAMES * 32);
+    }
+    std::cout << "slide: " << nanos[0] << " ns per voice frame read straight, " << nanos[1] << " gliding" << std::endl;
+
+    // pluck the A string open and drag up to the tenth fret, with and without
+    unsigned long long ended[2] = {}, slides[2] = {};
+    for (int legato = 1; legato >= 0; legato--)
+    {
+        AudioConfig config;
+        config.output = AudioOutput::Offline;
+        config.legatoSlides = legato != 0;
+        if (!AudioEngine::init(config)) return -1;
+
+        AudioEngine::playNote(AudioEngine::stringNames[1], 0, 0.5f);
+        for (int fret = 1; fret <= 10; fret++)
+        {
+            AudioEngine::advance(fretFrames);
+            AudioEngine::slideNote(AudioEngine::stringNames[1], fret, 0.5f);
+        }
+        AudioEngine::advance(Mixer::SAMPLE_RATE / 2);
+        AudioEngine::stopNotes(AudioEngine::stringNames[1]);
+        AudioEngine::advance(Mixer::SAMPLE_RATE / 10);
+
+        VoiceStats vs = AudioEngine::voiceStats();
+        ended[legato] = vs.ended;
+        slides[legato] = vs.slides;
+        AudioEngine::shutdown();
+    }
+
+    bool oneVoice = ended[1] == 1 && slides[1] == 10 && ended[0] == 11 && slides[0] == 0;
+    std::cout << "slide: through the engine, " << ended[1] << " voice with legato slides (" << slides[1]
+        << " frets slid), " << ended[0] << " without" << (oneVoice ? "" : " - FAILED") << std::endl;
+
+    return pitched && oneVoice ? 0 : -1;
+}
+
+// a 2 s stereo room response of decaying noise on the output: first
+// inline, against direct convolution at frames around every partition
+// boundary, then in real time with the tail on the worker, where the audio
+// thread and the worker together have to take under 10% of one core and
+// never miss a tail partition
+static int benchConvolve()
+{
+    const uint32_t irFrames = 2 * Mixer::SAMPLE_RATE;
+    std::vector<float> ir[2];
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    for (int c = 0; c < 2; c++)
+    {
+        ir[c].resize(irFrames);
+        for (uint32_t i = 0; i < irFrames; i++)
+            ir[c][i] = 0.1f * noise(rng) * std::exp(-6.9f * i / irFrames);
+    }
+
+    const uint32_t frames = 3 * Mixer::SAMPLE_RATE;
+    std::vector<float> input((size_t)frames * 2);
+    for (auto& x : input) x = noise(rng);
+
+    static Convolver convolver;
+    convolver.load(ir[0].data(), ir[1].data(), irFrames);
+    convolver.setMix(0.0f, 1.0f);
+    convolver.start(false);
+
+    std::vector<float> output = input;
+    auto start = Clock::now();
+    // uneven blocks, so partitions get completed partway through them
+    for (uint32_t at = 0, n = 0; at < frames; at += n)
+    {
+        n = std::min(1 + (at * 7919u) % (2 * Mixer::BLOCK_FRAMES), frames - at);
+        convolver.process(&output[(size_t)at * 2], n);
+    }
+    double inlineLoad = secondsSince(start) / ((double)frames / Mixer::SAMPLE_RATE);
+
+    const uint32_t edges[] = { 0, Convolver::HEAD, Convolver::TAIL, Convolver::TAIL_START,
+        Convolver::TAIL_START + Convolver::TAIL, irFrames, frames - 1 };
+    double worst = 0.0, rms = 0.0;
+    int checked = 0;
+    for (uint32_t edge : edges)
+    {
+        for (int d = -3; d <= 3; d++)
+        {
+            if ((int64_t)edge + d < 0 || edge + d >= frames) continue;
+            uint32_t n = edge + d;
+            for (int c = 0; c < 2; c++)
+            {
+                double sum = 0.0;
+                for (uint32_t k = 0; k <= std::min(n, irFrames - 1); k++)
+                    sum += (double)ir[c][k] * input[(size_t)(n - k) * 2 + c];
+                worst = std::max(worst, std::fabs(sum - output[(size_t)n * 2 + c]));
+                rms += sum * sum;
+                checked++;
+            }
+        }
+    }
+    rms = std::sqrt(rms / checked);
+    bool exact = worst < 1e-4 * rms + 1e-6;
+
+    std::cout << "convolve: " << irFrames / (double)Mixer::SAMPLE_RATE << " s stereo response inline, "
+        << inlineLoad * 100.0 << "% of one core, largest error " << worst << " against direct convolution at "
+        << checked << " frames (output RMS " << rms << ")" << (exact ? "" : " - FAILED") << std::endl;
+
+    // real time, paced like a device pulling blocks
+    convolver.start(true);
+    const int blocks = 5 * Mixer::SAMPLE_RATE / Mixer::BLOCK_FRAMES;
+    const auto period = std::chrono::nanoseconds(1000000000ll * Mixer::BLOCK_FRAMES / Mixer::SAMPLE_RATE);
+    std::vector<float> block(Mixer::BLOCK_FRAMES * 2);
+    double audioThread = 0.0;
+    auto begin = Clock::now();
+    for (int b = 0; b < blocks; b++)
+    {
+        std::this_thread::sleep_until(begin + period * b);
+        memcpy(block.data(), &input[(size_t)(b * Mixer::BLOCK_FRAMES % (frames - Mixer::BLOCK_FRAMES)) * 2],
+            block.size() * sizeof(float));
+        auto t = Clock::now();
+        convolver.process(block.data(), Mixer::BLOCK_FRAMES);
+        audioThread += secondsSince(t);
+    }
+    convolver.stop();
+
+    double seconds = (double)blocks * Mixer::BLOCK_FRAMES / Mixer::SAMPLE_RATE;
+    double load = (audioThread + convolver.workerSeconds()) / seconds;
+    bool fast = load < 0.10 && convolver.lateTails() == 0;
+    std::cout << "convolve: in real time, " << audioThread / seconds * 100.0 << "% of one core on the audio thread, "
+        << convolver.workerSeconds() / seconds * 100.0 << "% on the worker, " << load * 100.0 << "% together, "
+        << convolver.lateTails() << " tail partitions late" << (fast ? "" : " - FAILED") << std::endl;
+
+    // through the engine offline, with a recorded note standing in for a
+    // body response
+    AudioConfig config;
+    config.output = AudioOutput::Offline;
+    config.impulseResponsePath = AudioEngine::samplePath(0, 0);
+    if (!AudioEngine::init(config)) return -1;
+
+    auto engineStart = Clock::now();
+    for (int b = 0; b < 20; b++)
+    {
+        for (int s = 0; s < AudioEngine::STRINGS; s++)
+        {
+            AudioEngine::playNote(AudioEngine::stringNames[s], (b + s) % AudioEngine::RECORDED_FRETS, 0.05f);
+            AudioEngine::advance(Mixer::SAMPLE_RATE / 100);
+        }
+        AudioEngine::advance(Mixer::SAMPLE_RATE / 2 - AudioEngine::STRINGS * Mixer::SAMPLE_RATE / 100);
+    }
+    double engineSeconds = secondsSince(engineStart);
+    double audioSeconds = (double)AudioEngine::clock() / Mixer::SAMPLE_RATE;
+    AudioEngine::shutdown();
+
+    std::cout << "convolve: strummed through the engine with " << config.impulseResponsePath << " as the response, "
+        << audioSeconds / engineSeconds << "x real time" << std::endl;
+
+    return exact && fast ? 0 : -1;
+}
+
+// plays through ALSA's null device and through its file plugin for a second
+// each, so the backend can be checked without sound hardware; the file has
+// to hold every frame the mixer rendered but the block cut off at shutdown
+static int benchAlsa()
+{
+#ifdef ALSABACKEND_AVAILABLE
+    const char* path = "alsa-bench.raw";
+    const std::string devices[2] = { "null", std::string("file:FILE=") + path + ",FORMAT=raw" };
+    int result = 0;
+
+    for (const std::string& device : devices)
+    {
+        AudioConfig config;
+        config.alsaDevice = device;
+        config.blockFrames = 128;
+        config.outputBuffers = 3;
+        if (!AudioEngine::init(config)) return -1;
+
+        for (int n = 0; n < 20; n++)
+        {
+            AudioEngine::playNote(AudioEngine::stringNames[n % AudioEngine::STRINGS], n % AudioEngine::RECORDED_FRETS, 0.2f);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+
+        RenderStats rs = AudioEngine::renderStats();
+        double latency = AudioEngine::outputLatencyMs();
+        AudioEngine::shutdown();
+        uint64_t rendered = AudioEngine::clock();
+
+        std::cout << "alsa (" << device << "): " << rendered << " frames in 1 s, " << rs.xruns << " xruns, "
+            << latency << " ms latency, worst block " << rs.worstMs << " ms";
+
+        if (device != "null") {
+            std::vector<uint8_t> bytes;
+            const size_t frameBytes = Mixer::CHANNELS * sizeof(float);
+            bool complete = readFile(path, bytes) && bytes.size() <= rendered * frameBytes &&
+                bytes.size() + config.blockFrames * frameBytes >= rendered * frameBytes;
+            std::remove(path);
+            std::cout << ", " << bytes.size() << " bytes written, " << (complete ? "all of them" : "FRAMES MISSING");
+            if (!complete) result = -1;
+        }
+        std::cout << std::endl;
+    }
+
+    return result;
+#else
+    std::cout << "alsa: built without ALSA" << std::endl;
+    return 0;
+#endif
+}
+
+// cost of playNote itself when notes are triggered faster than they end
+static int benchTrigger()
+{
+    AudioConfig config;
+    config.output = AudioOutput::Offline;
+    if (!AudioEngine::init(config)) return -1;
+
+    const uint32_t intervals[] = { 4410, 441, 64, 16 };
+    const int notes = 20000;
+
+    for (uint32_t interval : intervals)
+    {
+        double playSeconds = 0.0;
+        double worst = 0.0;
+
+        for (int n = 0; n < notes; n++)
+        {
+            int s = n % AudioEngine::STRINGS;
+            int f = (n / AudioEngine::STRINGS) % AudioEngine::RECORDED_FRETS;
+
+            auto start = Clock::now();
+            AudioEngine::playNote(AudioEngine::stringNames[s], f, 0.1f);
+            double t = secondsSince(start);
+
+            playSeconds += t;
+            worst = std::max(worst, t);
+            AudioEngine::advance(interval);
+        }
+
+        std::cout << "trigger: " << Mixer::SAMPLE_RATE / (double)interval << " notes/s, playNote "
+            << playSeconds * 1e9 / notes << " ns average, " << worst * 1e6 << " us worst" << std::endl;
+
+        AudioEngine::stopAllNotes();
+    }
+
+    AudioEngine::shutdown();
+    return 0;
+}
+
+// hands numbered commands from one thread to another through the lock-free
+// ring, as the UI does to the audio thread; every one has to arrive in order
+static int benchQueue()
+{
+    struct Item { uint32_t seq; float payload[15]; }; // about a note command
+    static SpscQueue<Item, 256> queue;
+    const uint32_t count = 1000000;
+
+    std::atomic<bool> ordered(true);
+    auto start = Clock::now();
+
+    std::thread consumer([&]() {
+        Item item;
+        for (uint32_t expected = 0; expected < count; )
+        {
+            if (!queue.pop(item)) { std::this_thread::yield(); continue; }
+            if (item.seq != expected) ordered = false;
+            expected++;
+        }
+    });
+
+    unsigned long long full = 0;
+    Item item{};
+    for (uint32_t i = 0; i < count; )
+    {
+        item.seq = i;
+        if (queue.push(item)) { i++; continue; }
+        full++;
+        std::this_thread::yield();
+    }
+
+    consumer.join();
+    double seconds = secondsSince(start);
+
+    std::cout << "queue: " << count << " commands across threads in " << seconds << " s, "
+        << seconds * 1e9 / count << " ns each, producer found it full " << full << " times, "
+        << (ordered ? "all in order" : "OUT OF ORDER") << std::endl;
+
+    return ordered ? 0 : -1;
+}
+
+struct Benchmark {
+    const char* name;
+    int (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    { "wav", benchWavParser },
+    { "codec", benchCodec },
+    { "mix", benchMixFormats },
+    { "kernels", benchKernels },
+    { "stream", benchStreaming },
+    { "render", benchRender },
+    { "offline", benchOffline },
+    { "latency", benchLatency },
+    { "synth", benchSynth },
+    { "bank", benchBank },
+    { "trigger", benchTrigger },
+    { "schedule", benchSchedule },
+    { "stop", benchStop },
+    { "slide", benchSlide },
+    { "convolve", benchConvolve },
+    { "queue", benchQueue },
+    { "alsa", benchAlsa },
+};
+
+int runBenchmark(const std::string& name)
+{
+    int result = 0;
+    bool found = false;
+
+    for (const auto& b : benchmarks)
+    {
+        if (!name.empty() && name != b.name) continue;
+
+        found = true;
+        if (b.run() != 0) result = -1;
+    }
+
+    if (!found) {
+        std::cout << "Unknown benchmark \"" << name << "\", available:";
+        for (const auto& b : benchmarks) std::cout << " " << b.name;
+        std::cout << std::endl;
+        return -1;
+    }
+
+    return result;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <string>
+
+// offline benchmarks, run with --bench [name]; an empty name runs all of them
+int runBenchmark(const std::string& name);
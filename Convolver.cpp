@@ -0,0 +1,419 @@
+#include "Convolver.h"
+#include "WavParser.h"
+#include "PlanarSamples.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+constexpr uint32_t Convolver::HEAD;
+constexpr uint32_t Convolver::TAIL;
+constexpr uint32_t Convolver::TAIL_START;
+
+// the input segments kept for the worker, see tailIn
+static const uint32_t TAIL_SEGMENTS = 4;
+
+void Convolver::Fft::init(uint32_t size)
+{
+    n = size;
+    int bits = 0;
+    while ((1u << bits) < n) bits++;
+
+    reversed.resize(n);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; b++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        reversed[i] = r;
+    }
+
+    cosTable.resize(n / 2);
+    sinTable.resize(n / 2);
+    for (uint32_t i = 0; i < n / 2; i++)
+    {
+        double angle = 2.0 * 3.14159265358979323846 * i / n;
+        cosTable[i] = (float)std::cos(angle);
+        sinTable[i] = (float)std::sin(angle);
+    }
+}
+
+void Convolver::Fft::transform(float* re, float* im, bool inverse) const
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t r = reversed[i];
+        if (r > i) {
+            std::swap(re[i], re[r]);
+            std::swap(im[i], im[r]);
+        }
+    }
+
+    // e^(-2 pi i k / n) forwards, e^(+2 pi i k / n) back
+    float sign = inverse ? 1.0f : -1.0f;
+    for (uint32_t half = 1; half < n; half *= 2)
+    {
+        uint32_t stride = n / (2 * half);
+        for (uint32_t j = 0; j < half; j++)
+        {
+            float wr = cosTable[j * stride];
+            float wi = sign * sinTable[j * stride];
+            for (uint32_t i = j; i < n; i += 2 * half)
+            {
+                uint32_t k = i + half;
+                float tr = re[k] * wr - im[k] * wi;
+                float ti = re[k] * wi + im[k] * wr;
+                re[k] = re[i] - tr;
+                im[k] = im[i] - ti;
+                re[i] += tr;
+                im[i] += ti;
+            }
+        }
+    }
+}
+
+void Convolver::Stage::init(const float* left, const float* right, uint32_t irFrames, uint32_t offset, uint32_t partition, uint32_t partitions)
+{
+    size = partition;
+    count = partitions;
+    bins = size + 1;
+    newest = 0;
+    fft.init(2 * size);
+    re.assign(2 * size, 0.0f);
+    im.assign(2 * size, 0.0f);
+
+    for (int c = 0; c < 2; c++)
+    {
+        irRe[c].assign((size_t)count * bins, 0.0f);
+        irIm[c].assign((size_t)count * bins, 0.0f);
+        inRe[c].assign((size_t)count * bins, 0.0f);
+        inIm[c].assign((size_t)count * bins, 0.0f);
+        accRe[c].assign(bins, 0.0f);
+        accIm[c].assign(bins, 0.0f);
+    }
+
+    // each partition zero-padded to twice its length, so the last half of
+    // the circular convolution is the linear one; the inverse FFT's 1/n is
+    // folded in here
+    const uint32_t n = 2 * size;
+    const float scale = 1.0f / n;
+    for (uint32_t p = 0; p < count; p++)
+    {
+        std::fill(re.begin(), re.end(), 0.0f);
+        std::fill(im.begin(), im.end(), 0.0f);
+        for (uint32_t i = 0; i < size; i++)
+        {
+            uint32_t tap = offset + p * size + i;
+            if (tap >= irFrames) break;
+            re[i] = left[tap] * scale;
+            im[i] = right[tap] * scale;
+        }
+        fft.transform(re.data(), im.data(), false);
+
+        // X = L + iR, so L[k] = (X[k] + conj X[n-k]) / 2 and
+        // R[k] = (X[k] - conj X[n-k]) / 2i
+        float* lr = &irRe[0][(size_t)p * bins];
+        float* li = &irIm[0][(size_t)p * bins];
+        float* rr = &irRe[1][(size_t)p * bins];
+        float* ri = &irIm[1][(size_t)p * bins];
+        for (uint32_t k = 0; k < bins; k++)
+        {
+            uint32_t m = (n - k) & (n - 1);
+            lr[k] = 0.5f * (re[k] + re[m]);
+            li[k] = 0.5f * (im[k] - im[m]);
+            rr[k] = 0.5f * (im[k] + im[m]);
+            ri[k] = 0.5f * (re[m] - re[k]);
+        }
+    }
+}
+
+void Convolver::Stage::reset()
+{
+    for (int c = 0; c < 2; c++)
+    {
+        std::fill(inRe[c].begin(), inRe[c].end(), 0.0f);
+        std::fill(inIm[c].begin(), inIm[c].end(), 0.0f);
+    }
+    newest = 0;
+}
+
+void Convolver::Stage::run(const float* windowLeft, const float* windowRight, float* outLeft, float* outRight)
+{
+    const uint32_t n = 2 * size;
+    memcpy(re.data(), windowLeft, n * sizeof(float));
+    memcpy(im.data(), windowRight, n * sizeof(float));
+    fft.transform(re.data(), im.data(), false);
+
+    // the oldest spectrum drops out of the ring for the new one
+    newest = newest == 0 ? count - 1 : newest - 1;
+    float* lr = &inRe[0][(size_t)newest * bins];
+    float* li = &inIm[0][(size_t)newest * bins];
+    float* rr = &inRe[1][(size_t)newest * bins];
+    float* ri = &inIm[1][(size_t)newest * bins];
+    for (uint32_t k = 0; k < bins; k++)
+    {
+        uint32_t m = (n - k) & (n - 1);
+        lr[k] = 0.5f * (re[k] + re[m]);
+        li[k] = 0.5f * (im[k] - im[m]);
+        rr[k] = 0.5f * (im[k] + im[m]);
+        ri[k] = 0.5f * (re[m] - re[k]);
+    }
+
+    // input partition j back times response partition j, summed
+    for (int c = 0; c < 2; c++)
+    {
+        float* ar = accRe[c].data();
+        float* ai = accIm[c].data();
+        std::fill(ar, ar + bins, 0.0f);
+        std::fill(ai, ai + bins, 0.0f);
+
+        for (uint32_t p = 0; p < count; p++)
+        {
+            uint32_t slot = newest + p < count ? newest + p : newest + p - count;
+            const float* xr = &inRe[c][(size_t)slot * bins];
+            const float* xi = &inIm[c][(size_t)slot * bins];
+            const float* hr = &irRe[c][(size_t)p * bins];
+            const float* hi = &irIm[c][(size_t)p * bins];
+            for (uint32_t k = 0; k < bins; k++)
+            {
+                ar[k] += xr[k] * hr[k] - xi[k] * hi[k];
+                ai[k] += xr[k] * hi[k] + xi[k] * hr[k];
+            }
+        }
+    }
+
+    // back to one spectrum, Y = L + iR, the upper half mirrored from the
+    // lower one as both channels are real
+    for (uint32_t k = 0; k < bins; k++)
+    {
+        re[k] = accRe[0][k] - accIm[1][k];
+        im[k] = accIm[0][k] + accRe[1][k];
+    }
+    for (uint32_t k = bins; k < n; k++)
+    {
+        uint32_t m = n - k;
+        re[k] = accRe[0][m] + accIm[1][m];
+        im[k] = accRe[1][m] - accIm[0][m];
+    }
+    fft.transform(re.data(), im.data(), true);
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        outLeft[i] += re[size + i];
+        outRight[i] += im[size + i];
+    }
+}
+
+Convolver::~Convolver()
+{
+    stop();
+}
+
+void Convolver::load(const float* left, const float* right, uint32_t frames)
+{
+    stop();
+    irFrames = frames;
+
+    for (int c = 0; c < 2; c++)
+    {
+        const float* taps = c == 0 ? left : right;
+        head[c].assign(HEAD, 0.0f);
+        std::copy(taps, taps + std::min(frames, HEAD), head[c].begin());
+    }
+
+    uint32_t nearEnd = std::min(frames, TAIL_START);
+    near.init(left, right, frames, HEAD, HEAD, nearEnd > HEAD ? (nearEnd - HEAD + HEAD - 1) / HEAD : 0);
+    far.init(left, right, frames, TAIL_START, TAIL, frames > TAIL_START ? (frames - TAIL_START + TAIL - 1) / TAIL : 0);
+
+    for (int c = 0; c < 2; c++)
+    {
+        tailIn[c].assign((size_t)TAIL_SEGMENTS * TAIL, 0.0f);
+        farWindow[c].assign(2 * TAIL, 0.0f);
+        for (int slot = 0; slot < 2; slot++)
+            tailOut[slot][c].assign(TAIL, 0.0f);
+    }
+}
+
+const char* Convolver::loadWav(const std::string& path)
+{
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) return "missing WAV file";
+
+    std::streamoff length = f.tellg();
+    if (length < 0) return "unreadable WAV file";
+
+    std::vector<uint8_t> file((size_t)length);
+    f.seekg(0);
+    f.read((char*)file.data(), file.size());
+    if (!f) return "unreadable WAV file";
+
+    WavInfo info;
+    WavError error = parseWav(file.data(), file.size(), info);
+    if (error != WavError::None) return wavErrorString(error);
+    if (info.sampleRate != Mixer::SAMPLE_RATE) return "impulse response is not at 44.1 kHz";
+    if (info.channels < 1 || info.channels > 2) return "impulse response is neither mono nor stereo";
+
+    PlanarSamples planar;
+    if (!planar.convert(info.data, (uint32_t)(info.dataSize / info.blockAlign), info.channels,
+        info.bitsPerSample, info.formatTag == WavInfo::FORMAT_IEEE_FLOAT))
+        return "unsupported impulse response format";
+    if (planar.empty()) return "empty impulse response";
+
+    load(planar.channel(0), planar.channel(planar.channelCount() - 1), planar.frameCount());
+    return nullptr;
+}
+
+void Convolver::start(bool inBackground)
+{
+    stop();
+
+    for (int c = 0; c < 2; c++)
+    {
+        std::fill(tailIn[c].begin(), tailIn[c].end(), 0.0f);
+        for (int slot = 0; slot < 2; slot++)
+            std::fill(tailOut[slot][c].begin(), tailOut[slot][c].end(), 0.0f);
+    }
+    memset(window, 0, sizeof(window));
+    memset(nearOut, 0, sizeof(nearOut));
+    near.reset();
+    far.reset();
+    fill = tailFill = 0;
+    segment = 0;
+    tailReady = false;
+    submitted = completed = 0;
+    late = 0;
+    workerNanos = 0;
+
+    background = inBackground && !far.empty();
+    if (background) {
+        stopping = false;
+        worker = std::thread(&Convolver::workerLoop, this);
+    }
+}
+
+void Convolver::stop()
+{
+    if (!worker.joinable()) return;
+
+    stopping = true;
+    wake.signal();
+    worker.join();
+}
+
+void Convolver::process(float* out, uint32_t frames)
+{
+    if (irFrames == 0) return;
+
+    float convolved[2][HEAD];
+    uint32_t done = 0;
+
+    while (done < frames)
+    {
+        // never past the end of a partition; TAIL is a multiple of HEAD, so
+        // that is never past the end of a segment either
+        uint32_t n = std::min(frames - done, HEAD - fill);
+        float* io = out + (size_t)done * Mixer::CHANNELS;
+        float* in = nullptr;
+
+        for (int c = 0; c < 2; c++)
+        {
+            in = &tailIn[c][(size_t)(segment % TAIL_SEGMENTS) * TAIL + tailFill];
+            for (uint32_t i = 0; i < n; i++)
+                window[c][HEAD + fill + i] = in[i] = io[2 * i + c];
+
+            const float* tail = tailReady ? &tailOut[segment % 2][c][tailFill] : nullptr;
+            for (uint32_t i = 0; i < n; i++)
+                convolved[c][i] = nearOut[c][fill + i] + (tail ? tail[i] : 0.0f);
+
+            // tap k reaches k frames back, into the previous partition at most
+            for (uint32_t k = 0; k < HEAD; k++)
+            {
+                float h = head[c][k];
+                const float* x = &window[c][HEAD + fill - k];
+                for (uint32_t i = 0; i < n; i++)
+                    convolved[c][i] += h * x[i];
+            }
+
+            for (uint32_t i = 0; i < n; i++)
+                io[2 * i + c] = dry * io[2 * i + c] + wet * convolved[c][i];
+        }
+
+        fill += n;
+        tailFill += n;
+        done += n;
+
+        // the partition just completed is heard from the next frame on
+        if (fill == HEAD) {
+            memset(nearOut, 0, sizeof(nearOut));
+            if (!near.empty()) near.run(window[0], window[1], nearOut[0], nearOut[1]);
+            for (int c = 0; c < 2; c++)
+                memcpy(window[c], window[c] + HEAD, HEAD * sizeof(float));
+            fill = 0;
+        }
+
+        if (tailFill == TAIL) {
+            tailFill = 0;
+            if (!far.empty()) {
+                if (background) {
+                    submitted.store(segment + 1, std::memory_order_release);
+                    wake.signal();
+                } else {
+                    runTail(segment);
+                }
+            }
+            segment++;
+
+            // segment - 2 is due now
+            tailReady = segment >= 2 && completed.load(std::memory_order_acquire) >= segment - 1;
+            if (segment >= 2 && !far.empty() && !tailReady)
+                late.store(late.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Convolver::runTail(uint64_t k)
+{
+    // segment k - 1 is silence before the first one, tailIn starts cleared
+    for (int c = 0; c < 2; c++)
+    {
+        const float* previous = &tailIn[c][(size_t)((k + TAIL_SEGMENTS - 1) % TAIL_SEGMENTS) * TAIL];
+        const float* current = &tailIn[c][(size_t)(k % TAIL_SEGMENTS) * TAIL];
+        memcpy(farWindow[c].data(), previous, TAIL * sizeof(float));
+        memcpy(farWindow[c].data() + TAIL, current, TAIL * sizeof(float));
+        std::fill(tailOut[k % 2][c].begin(), tailOut[k % 2][c].end(), 0.0f);
+    }
+
+    far.run(farWindow[0].data(), farWindow[1].data(), tailOut[k % 2][0].data(), tailOut[k % 2][1].data());
+    completed.store(k + 1, std::memory_order_release);
+}
+
+void Convolver::workerLoop()
+{
+    uint64_t next = 0;
+
+    while (true)
+    {
+        uint64_t ready = submitted.load(std::memory_order_acquire);
+        // a segment submitted after the load above has signalled, so the
+        // wait returns at once for it
+        if (next >= ready) {
+            if (stopping) return;
+            wake.wait();
+            continue;
+        }
+
+        // so far behind that segment next - 1 is being overwritten: start
+        // over from the latest, the ones skipped are played silent anyway
+        if (ready - next > 2) {
+            far.reset();
+            next = ready - 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        runTail(next++);
+        uint64_t nanos = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        workerNanos.store(workerNanos.load(std::memory_order_relaxed) + nanos, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include "Mixer.h"
+#include "WakeSignal.h"
+
+// Convolves the stereo output with an impulse response, a guitar body or a
+// room, with no added latency and a cost that barely grows with its length.
+// The first HEAD taps are applied directly, so the convolved signal starts on
+// the same frame as the input. The taps up to TAIL_START go through a
+// uniformly partitioned overlap-save FFT in HEAD-frame partitions, each run
+// the moment its input is complete; the rest go through TAIL-frame
+// partitions, which a worker thread computes a whole partition before they
+// are heard. load() allocates everything, so process() never allocates or
+// locks.
+class Convolver : public Mixer::Effect
+{
+public:
+    static constexpr uint32_t HEAD = 128;
+    static constexpr uint32_t TAIL = 4096;
+    static constexpr uint32_t TAIL_START = 2 * TAIL;
+
+    Convolver() = default;
+    ~Convolver();
+
+    Convolver(const Convolver&) = delete;
+    Convolver& operator=(const Convolver&) = delete;
+
+    // `right` may be `left` for a mono response; stops the worker
+    void load(const float* left, const float* right, uint32_t frames);
+
+    // a response from a 44.1 kHz WAV file, mono or stereo; nullptr, or why
+    // it could not be loaded
+    const char* loadWav(const std::string& path);
+
+    uint32_t length() const { return irFrames; }
+
+    // out = dry * input + wet * convolved
+    void setMix(float dryLevel, float wetLevel) { dry = dryLevel; wet = wetLevel; }
+
+    // clears the history and, when `background`, starts the worker for the
+    // tail; without it the tail is computed inline in process(), so an
+    // offline render stays exact however fast it runs
+    void start(bool background);
+    void stop();
+
+    // interleaved stereo, in place
+    void process(float* out, uint32_t frames) override;
+
+    // tail partitions the worker did not finish in time, played silent
+    unsigned long long lateTails() const { return late.load(std::memory_order_relaxed); }
+    double workerSeconds() const { return workerNanos.load(std::memory_order_relaxed) * 1e-9; }
+
+private:
+    // radix-2 complex FFT on split real and imaginary parts
+    class Fft
+    {
+    public:
+        void init(uint32_t n);
+
+        // in place; the inverse leaves out the 1/n
+        void transform(float* re, float* im, bool inverse) const;
+
+    private:
+        uint32_t n = 0;
+        std::vector<uint32_t> reversed;
+        std::vector<float> cosTable, sinTable;
+    };
+
+    // uniformly partitioned overlap-save over taps [offset, offset +
+    // count * size). Both channels share one complex FFT, the left in the
+    // real part and the right in the imaginary one, and are separated by
+    // symmetry in between
+    class Stage
+    {
+    public:
+        void init(const float* left, const float* right, uint32_t irFrames, uint32_t offset, uint32_t size, uint32_t count);
+        void reset();
+        bool empty() const { return count == 0; }
+
+        // `window` holds the latest 2 * size input frames of a channel; adds
+        // what they contribute to the next `size` output frames
+        void run(const float* windowLeft, const float* windowRight, float* outLeft, float* outRight);
+
+    private:
+        Fft fft;
+        uint32_t size = 0;
+        uint32_t count = 0;
+        uint32_t bins = 0; // size + 1, up to Nyquist
+
+        // per channel, count partitions of bins each: the response's spectra,
+        // and the input's as a ring, newest at `newest` and older after it
+        std::vector<float> irRe[2], irIm[2];
+        std::vector<float> inRe[2], inIm[2];
+        uint32_t newest = 0;
+
+        std::vector<float> re, im;
+        std::vector<float> accRe[2], accIm[2];
+    };
+
+    void runTail(uint64_t segment);
+    void workerLoop();
+
+    uint32_t irFrames = 0;
+    float dry = 0.0f;
+    float wet = 1.0f;
+
+    // the first HEAD taps, and the input they reach back over: the previous
+    // HEAD frames, then those of the partition being filled
+    std::vector<float> head[2];
+    float window[2][2 * HEAD] = {};
+    uint32_t fill = 0;
+
+    // taps [HEAD, TAIL_START), heard over the partition being filled
+    Stage near;
+    float nearOut[2][HEAD] = {};
+
+    // taps from TAIL_START on. Segment k of the input is complete once the
+    // next one starts, and is heard from the start of segment k + 2, from
+    // output slot k % 2; the input keeps four segments so the worker can
+    // still read k - 1 and k while two more come in
+    Stage far;
+    std::vector<float> tailIn[2];
+    std::vector<float> tailOut[2][2];
+    std::vector<float> farWindow[2];
+    uint32_t tailFill = 0;
+    uint64_t segment = 0;
+    bool tailReady = false;
+
+    // segments handed to the worker and finished by it
+    std::atomic<uint64_t> submitted{ 0 };
+    std::atomic<uint64_t> completed{ 0 };
+    std::atomic<unsigned long long> late{ 0 };
+    std::atomic<unsigned long long> workerNanos{ 0 };
+
+    bool background = false;
+    std::thread worker;
+    WakeSignal wake;
+    std::atomic<bool> stopping{ false };
+};
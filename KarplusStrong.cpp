@@ -0,0 +1,103 @@
+#include "KarplusStrong.h"
+#include <algorithm>
+#include <cmath>
+
+constexpr int KarplusStrong::MAX_PERIOD;
+
+static const float SILENCE = 1e-4f; // -80 dBFS
+
+KarplusStrong::Loop KarplusStrong::design(const StringModel& string, int fret)
+{
+    float hz = string.openHz * std::pow(2.0f, fret / 12.0f);
+    float period = (float)Mixer::SAMPLE_RATE / hz;
+
+    // the loop delay is the line plus what each filter adds at low
+    // frequencies; the tuning allpass makes up the fraction, kept within
+    // [0.1, 1.1) samples where its delay stays flat
+    Loop loop;
+    loop.smoothing = 0.5f * (1.0f - std::min(std::max(string.brightness, 0.0f), 1.0f));
+    loop.dispersion = -0.5f * std::min(std::max(string.stiffness, 0.0f), 1.0f);
+    float dispersionDelay = (1.0f - loop.dispersion) / (1.0f + loop.dispersion);
+
+    float rest = period - loop.smoothing - dispersionDelay;
+    loop.length = std::max(2, std::min((int)std::floor(rest - 0.1f), MAX_PERIOD));
+    float fraction = std::min(std::max(rest - loop.length, 0.1f), 1.1f);
+    loop.tuning = (1.0f - fraction) / (1.0f + fraction);
+
+    // falls by 60 dB over decaySeconds, that is over decaySeconds * hz trips
+    loop.lossGain = std::pow(10.0f, -3.0f / (std::max(string.decaySeconds, 0.01f) * hz));
+    return loop;
+}
+
+float KarplusStrong::excite(float* line, int length, float pickPosition, float level, uint32_t seed)
+{
+    // uniform noise from a small LCG, without its DC so nothing lingers;
+    // consecutive seeds are spread first so their notes do not correlate
+    seed *= 2654435761u;
+    float mean = 0.0f;
+    for (int i = 0; i < length; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        line[i] = (float)(seed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+        mean += line[i];
+    }
+    mean /= length;
+
+    // plucking a point cancels the harmonics with a node there
+    float peak = 0.0f;
+    int pick = std::max(1, (int)std::lround(pickPosition * length));
+    for (int i = length - 1; i >= 0; i--)
+    {
+        line[i] = 0.5f * level * ((line[i] - mean) - (i >= pick ? line[i - pick] - mean : 0.0f));
+        peak = std::max(peak, std::fabs(line[i]));
+    }
+    return peak;
+}
+
+void KarplusStrong::pluck(const StringModel& string, int fret, uint32_t seed)
+{
+    loop = design(string, fret);
+    lossState = dispersionIn = dispersionOut = tuningIn = tuningOut = 0.0f;
+    position = 0;
+    age = 0;
+    silent = false;
+    peak = excite(line, loop.length, string.pickPosition, 1.0f, seed);
+}
+
+uint32_t KarplusStrong::generate(float* out, uint32_t frames)
+{
+    if (silent) return 0;
+
+    float blockPeak = 0.0f;
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        float y = line[position];
+
+        float loss = loop.lossGain * ((1.0f - loop.smoothing) * y + loop.smoothing * lossState);
+        lossState = y;
+
+        float dispersed = loop.dispersion * loss + dispersionIn - loop.dispersion * dispersionOut;
+        dispersionIn = loss;
+        dispersionOut = dispersed;
+
+        float tuned = loop.tuning * dispersed + tuningIn - loop.tuning * tuningOut;
+        tuningIn = dispersed;
+        tuningOut = tuned;
+
+        line[position] = tuned;
+        if (++position == loop.length) position = 0;
+
+        out[i] = y;
+        blockPeak = std::max(blockPeak, std::fabs(y));
+    }
+
+    peak = blockPeak;
+    age += frames;
+    if (age > (uint64_t)loop.length && peak < SILENCE) silent = true;
+    return frames;
+}
+
+float KarplusStrong::levelDb() const
+{
+    return 20.0f * std::log10(std::max(peak, 1e-6f));
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include "Mixer.h"
+
+// what a synthesised string sounds like
+struct StringModel
+{
+    float openHz = 82.41f;      // pitch of the open string
+    float decaySeconds = 4.0f;  // for a note to fall by 60 dB
+    float pickPosition = 0.13f; // where it is plucked, as a fraction of the length from the bridge
+    float brightness = 0.4f;    // 0 keeps only the lows ringing, 1 lets the highs ring as long
+    float stiffness = 0.1f;     // 0 is an ideal string, higher spreads the partials sharp
+};
+
+// Extended Karplus-Strong plucked string: a delay line about one period
+// long, fed back through a loss filter, a dispersion allpass for stiffness
+// and a fractional-delay allpass that tunes it between whole samples. The
+// pluck is a burst of noise combed at the pick position. Everything is
+// fixed size, so pluck() and generate() never allocate and can run on the
+// audio thread; the noise is seeded, so a render is repeatable.
+class KarplusStrong : public Mixer::Generator
+{
+public:
+    // longest period, so the lowest pitch is about 21.5 Hz
+    static constexpr int MAX_PERIOD = 2048;
+
+    // the feedback loop for a string stopped at a fret; the filters are
+    // described with the state below
+    struct Loop
+    {
+        int length = 2;
+        float lossGain = 0.0f;
+        float smoothing = 0.0f;
+        float dispersion = 0.0f;
+        float tuning = 0.0f;
+    };
+    static Loop design(const StringModel& string, int fret);
+
+    // the pluck for a loop `length` samples long, scaled by `level`;
+    // returns its peak
+    static float excite(float* line, int length, float pickPosition, float level, uint32_t seed);
+
+    void pluck(const StringModel& string, int fret, uint32_t seed);
+
+    // mono frames; none once the string has died away below -80 dBFS
+    uint32_t generate(float* out, uint32_t frames) override;
+
+    // peak of the last frames generated, for picking a voice to steal
+    float levelDb() const;
+
+private:
+    float line[MAX_PERIOD];
+    int position = 0;
+    uint64_t age = 0;
+    bool silent = true;
+    float peak = 0.0f;
+
+    // loop filters: loss gain * ((1 - smoothing) * y + smoothing * y[-1]),
+    // then two first-order allpasses (a + z^-1) / (1 + a z^-1)
+    Loop loop;
+    float lossState = 0.0f;
+    float dispersionIn = 0.0f, dispersionOut = 0.0f;
+    float tuningIn = 0.0f, tuningOut = 0.0f;
+};
@@ -10,9 +10,12 @@
 #include "Util.h"
 #include "GuitarString.h"
 #include "Audio.h"
+#include "Benchmark.h"
 
+#ifdef _WIN32
 #define NOMINMAX
 #include <windows.h>
+#endif
 
 // window
 #define FPS 75
@@ -33,8 +36,8 @@ int lastHitFret = 0;
 #define MARKER_RADIUS 0.013
 
 // mouse related stuff
-boolean isPressedLeft;
-boolean isPressedRight;
+bool isPressedLeft;
+bool isPressedRight;
 GLFWcursor* cursorReleased;
 GLFWcursor* cursorPressed;
 double mouseXNDC = 0.0, mouseYNDC = 0.0;
@@ -217,6 +220,7 @@ void drawStrings(unsigned int stringShader, unsigned int stringsVAO, unsigned in
     for (auto& string : strings)
     {
         bool trigger = false;
+        bool slide = false;
         float t = 1.0f;
 
         if (isPressedLeft) {
@@ -235,6 +239,8 @@ void drawStrings(unsigned int stringShader, unsigned int stringsVAO, unsigned in
             findClosestStringAndFret(mouseXNDC, mouseYNDC, strings, closestString, closestFret, distUp);
             if (distUp < string.thickness * 2.5f && strings[closestString].name == string.name 
                 && (closestFret != lastHitFret || string.name != lastHitStringName)) {
+                // dragging along the string it was pressed on slides the note
+                slide = string.name == lastHitStringName;
                 string.fretPressed = closestFret;
                 lastHitFret = closestFret;
                 lastHitStringName = string.name;
@@ -243,7 +249,13 @@ void drawStrings(unsigned int stringShader, unsigned int stringsVAO, unsigned in
             }
         }
 
-        if (trigger) {
+        if (trigger && slide) {
+            AudioEngine::slideNote(string.name, string.fretPressed, 1);
+            if (!string.isVibrating) {
+                string.isVibrating = true;
+                string.vibrationTime = 0.0f;
+            }
+        } else if (trigger) {
             AudioEngine::playNote(string.name, string.fretPressed, 1);
             string.isVibrating = true;
             string.vibrationTime = 0.0f;
@@ -402,8 +414,21 @@ void cursorPosCallback(GLFWwindow* window, double xpos, double ypos)
     mouseYNDC = 1.0f - (float)(ypos / height) * 2.0f;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // offline tools
+    if (argc > 1 && std::string(argv[1]) == "--pack-bank") {
+        std::string path = AudioEngine::BANK_PATH;
+        bool compress = false;
+        for (int i = 2; i < argc; i++) {
+            if (std::string(argv[i]) == "--compress") compress = true;
+            else path = argv[i];
+        }
+        return AudioEngine::packBank(path, compress) ? 0 : -1;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+        return runBenchmark(argc > 2 ? argv[2] : "");
+
     // glfw
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -503,6 +528,8 @@ int main()
         drawRect(rectShader, VAOsignature, signatureTexture);
 
         detectChords();
+        AudioEngine::setChordShape({ strings[0].fretPressed, strings[1].fretPressed, strings[2].fretPressed,
+            strings[3].fretPressed, strings[4].fretPressed, strings[5].fretPressed });
 
         drawStrings(stringShader, VAOstrings, vertexCount);
         drawFretCircles(circleShader, VAOunitCircle, unitCircleVertexCount);
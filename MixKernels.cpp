@@ -0,0 +1,356 @@
+#include "MixKernels.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIXKERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled in whenever the compiler can target it per function and
+// only used after the CPU has been checked
+#if defined(MIXKERNELS_SSE2) && (defined(_MSC_VER) || defined(__GNUC__))
+#define MIXKERNELS_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define MIXKERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+constexpr float MixKernels::TOLERANCE;
+
+static const float INT16_SCALE = 1.0f / 32768.0f;
+
+static float loadInt16(const uint8_t* p)
+{
+    int16_t v;
+    memcpy(&v, p, 2);
+    return v * INT16_SCALE;
+}
+
+// frames [first, frames) of a run; the vector loops finish their runs with
+// these, so every frame's gain comes out of the same expression
+static void planarScalarFrom(uint32_t first, const float* left, const float* right, uint32_t frames,
+    float gain, float step, float* out)
+{
+    for (uint32_t i = first; i < frames; i++)
+    {
+        float g = gain + (float)i * step;
+        out[2 * i] += left[i] * g;
+        out[2 * i + 1] += right[i] * g;
+    }
+}
+
+static void int16StereoScalarFrom(uint32_t first, const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    for (uint32_t i = first; i < frames; i++)
+    {
+        float g = gain + (float)i * step;
+        out[2 * i] += loadInt16(in + 4 * i) * g;
+        out[2 * i + 1] += loadInt16(in + 4 * i + 2) * g;
+    }
+}
+
+static void int16MonoScalarFrom(uint32_t first, const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    for (uint32_t i = first; i < frames; i++)
+    {
+        float v = loadInt16(in + 2 * i) * (gain + (float)i * step);
+        out[2 * i] += v;
+        out[2 * i + 1] += v;
+    }
+}
+
+static void planarScalar(const float* left, const float* right, uint32_t frames, float gain, float step, float* out)
+{
+    planarScalarFrom(0, left, right, frames, gain, step, out);
+}
+
+static void int16StereoScalar(const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    int16StereoScalarFrom(0, in, frames, gain, step, out);
+}
+
+static void int16MonoScalar(const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    int16MonoScalarFrom(0, in, frames, gain, step, out);
+}
+
+#ifdef MIXKERNELS_SSE2
+static inline __m128 rampSSE2(uint32_t i, float gain, float step)
+{
+    __m128 index = _mm_add_ps(_mm_set1_ps((float)i), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+    return _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(index, _mm_set1_ps(step)));
+}
+
+static inline void addSSE2(float* out, __m128 v)
+{
+    _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), v));
+}
+
+static void planarSSE2(const float* left, const float* right, uint32_t frames, float gain, float step, float* out)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128 g = rampSSE2(i, gain, step);
+        __m128 l = _mm_mul_ps(_mm_loadu_ps(left + i), g);
+        __m128 r = _mm_mul_ps(_mm_loadu_ps(right + i), g);
+        addSSE2(out + 2 * i, _mm_unpacklo_ps(l, r));
+        addSSE2(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+    }
+    planarScalarFrom(i, left, right, frames, gain, step, out);
+}
+
+static inline __m128 int16ToFloatSSE2(__m128i lanes)
+{
+    // sign-extends by moving each sample to the top half first
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(lanes, 16)), _mm_set1_ps(INT16_SCALE));
+}
+
+static void int16StereoSSE2(const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + 4 * i));
+        __m128 g = rampSSE2(i, gain, step);
+        __m128 lo = int16ToFloatSSE2(_mm_unpacklo_epi16(x, x)); // L0 R0 L1 R1
+        __m128 hi = int16ToFloatSSE2(_mm_unpackhi_epi16(x, x)); // L2 R2 L3 R3
+        addSSE2(out + 2 * i, _mm_mul_ps(lo, _mm_unpacklo_ps(g, g)));
+        addSSE2(out + 2 * i + 4, _mm_mul_ps(hi, _mm_unpackhi_ps(g, g)));
+    }
+    int16StereoScalarFrom(i, in, frames, gain, step, out);
+}
+
+static void int16MonoSSE2(const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128i x = _mm_loadl_epi64((const __m128i*)(in + 2 * i));
+        __m128 v = _mm_mul_ps(int16ToFloatSSE2(_mm_unpacklo_epi16(x, x)), rampSSE2(i, gain, step));
+        addSSE2(out + 2 * i, _mm_unpacklo_ps(v, v));
+        addSSE2(out + 2 * i + 4, _mm_unpackhi_ps(v, v));
+    }
+    int16MonoScalarFrom(i, in, frames, gain, step, out);
+}
+#endif
+
+#ifdef MIXKERNELS_AVX2
+AVX2_TARGET static inline __m256 rampAVX2(uint32_t i, float gain, float step)
+{
+    __m256 index = _mm256_add_ps(_mm256_set1_ps((float)i), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+    return _mm256_add_ps(_mm256_set1_ps(gain), _mm256_mul_ps(index, _mm256_set1_ps(step)));
+}
+
+AVX2_TARGET static inline void addAVX2(float* out, __m256 v)
+{
+    _mm256_storeu_ps(out, _mm256_add_ps(_mm256_loadu_ps(out), v));
+}
+
+// the scalar tails are SSE code, which stalls on dirty upper register halves
+// on some CPUs; every AVX2 loop clears them before handing over
+
+// a and b are frame pairs per 128-bit half (0 1 | 4 5 and 2 3 | 6 7); this
+// writes frames 0-3 then 4-7
+AVX2_TARGET static inline void addHalvesAVX2(float* out, __m256 a, __m256 b)
+{
+    addAVX2(out, _mm256_permute2f128_ps(a, b, 0x20));
+    addAVX2(out + 8, _mm256_permute2f128_ps(a, b, 0x31));
+}
+
+AVX2_TARGET static void planarAVX2(const float* left, const float* right, uint32_t frames, float gain, float step, float* out)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m256 g = rampAVX2(i, gain, step);
+        __m256 l = _mm256_mul_ps(_mm256_loadu_ps(left + i), g);
+        __m256 r = _mm256_mul_ps(_mm256_loadu_ps(right + i), g);
+        addHalvesAVX2(out + 2 * i, _mm256_unpacklo_ps(l, r), _mm256_unpackhi_ps(l, r));
+    }
+    _mm256_zeroupper();
+    planarScalarFrom(i, left, right, frames, gain, step, out);
+}
+
+AVX2_TARGET static inline __m256 int16ToFloatAVX2(const uint8_t* p)
+{
+    __m128i x = _mm_loadu_si128((const __m128i*)p);
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(x)), _mm256_set1_ps(INT16_SCALE));
+}
+
+AVX2_TARGET static void int16StereoAVX2(const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    const __m256i first = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i second = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+
+    uint32_t i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m256 g = rampAVX2(i, gain, step);
+        __m256 lo = int16ToFloatAVX2(in + 4 * i);      // frames 0-3, interleaved
+        __m256 hi = int16ToFloatAVX2(in + 4 * i + 16); // frames 4-7
+        addAVX2(out + 2 * i, _mm256_mul_ps(lo, _mm256_permutevar8x32_ps(g, first)));
+        addAVX2(out + 2 * i + 8, _mm256_mul_ps(hi, _mm256_permutevar8x32_ps(g, second)));
+    }
+    _mm256_zeroupper();
+    int16StereoScalarFrom(i, in, frames, gain, step, out);
+}
+
+AVX2_TARGET static void int16MonoAVX2(const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m256 v = _mm256_mul_ps(int16ToFloatAVX2(in + 2 * i), rampAVX2(i, gain, step));
+        addHalvesAVX2(out + 2 * i, _mm256_unpacklo_ps(v, v), _mm256_unpackhi_ps(v, v));
+    }
+    _mm256_zeroupper();
+    int16MonoScalarFrom(i, in, frames, gain, step, out);
+}
+
+static bool cpuHasAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // the OS also has to save the upper halves of the registers
+    __cpuid(info, 1);
+    const int osxsave = 1 << 27, avx = 1 << 28;
+    if ((info[2] & (osxsave | avx)) != (osxsave | avx)) return false;
+    if ((_xgetbv(0) & 6) != 6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+#ifdef MIXKERNELS_NEON
+static inline float32x4_t rampNEON(uint32_t i, float gain, float step)
+{
+    const float lanes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float32x4_t index = vaddq_f32(vdupq_n_f32((float)i), vld1q_f32(lanes));
+    return vaddq_f32(vdupq_n_f32(gain), vmulq_f32(index, vdupq_n_f32(step)));
+}
+
+static inline void addNEON(float* out, float32x4_t v)
+{
+    vst1q_f32(out, vaddq_f32(vld1q_f32(out), v));
+}
+
+static inline float32x4_t int16ToFloatNEON(int16x4_t x)
+{
+    return vmulq_f32(vcvtq_f32_s32(vmovl_s16(x)), vdupq_n_f32(INT16_SCALE));
+}
+
+static void planarNEON(const float* left, const float* right, uint32_t frames, float gain, float step, float* out)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        float32x4_t g = rampNEON(i, gain, step);
+        float32x4x2_t lr = vzipq_f32(vmulq_f32(vld1q_f32(left + i), g), vmulq_f32(vld1q_f32(right + i), g));
+        addNEON(out + 2 * i, lr.val[0]);
+        addNEON(out + 2 * i + 4, lr.val[1]);
+    }
+    planarScalarFrom(i, left, right, frames, gain, step, out);
+}
+
+static void int16StereoNEON(const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        int16x8_t x = vreinterpretq_s16_u8(vld1q_u8(in + 4 * i));
+        float32x4x2_t g = vzipq_f32(rampNEON(i, gain, step), rampNEON(i, gain, step));
+        addNEON(out + 2 * i, vmulq_f32(int16ToFloatNEON(vget_low_s16(x)), g.val[0]));
+        addNEON(out + 2 * i + 4, vmulq_f32(int16ToFloatNEON(vget_high_s16(x)), g.val[1]));
+    }
+    int16StereoScalarFrom(i, in, frames, gain, step, out);
+}
+
+static void int16MonoNEON(const uint8_t* in, uint32_t frames, float gain, float step, float* out)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        int16x4_t x = vreinterpret_s16_u8(vld1_u8(in + 2 * i));
+        float32x4_t v = vmulq_f32(int16ToFloatNEON(x), rampNEON(i, gain, step));
+        float32x4x2_t both = vzipq_f32(v, v);
+        addNEON(out + 2 * i, both.val[0]);
+        addNEON(out + 2 * i + 4, both.val[1]);
+    }
+    int16MonoScalarFrom(i, in, frames, gain, step, out);
+}
+#endif
+
+static const MixKernels scalarKernels = {
+    MixKernels::Isa::Scalar, "scalar", planarScalar, int16StereoScalar, int16MonoScalar
+};
+
+#ifdef MIXKERNELS_SSE2
+static const MixKernels sse2Kernels = {
+    MixKernels::Isa::SSE2, "SSE2", planarSSE2, int16StereoSSE2, int16MonoSSE2
+};
+#endif
+
+#ifdef MIXKERNELS_AVX2
+static const MixKernels avx2Kernels = {
+    MixKernels::Isa::AVX2, "AVX2", planarAVX2, int16StereoAVX2, int16MonoAVX2
+};
+#endif
+
+#ifdef MIXKERNELS_NEON
+static const MixKernels neonKernels = {
+    MixKernels::Isa::NEON, "NEON", planarNEON, int16StereoNEON, int16MonoNEON
+};
+#endif
+
+const MixKernels* MixKernels::get(Isa isa)
+{
+    switch (isa) {
+    case Isa::Scalar:
+        return &scalarKernels;
+#ifdef MIXKERNELS_SSE2
+    case Isa::SSE2:
+        return &sse2Kernels;
+#endif
+#ifdef MIXKERNELS_AVX2
+    case Isa::AVX2: {
+        static const bool supported = cpuHasAVX2();
+        return supported ? &avx2Kernels : nullptr;
+    }
+#endif
+#ifdef MIXKERNELS_NEON
+    case Isa::NEON:
+        return &neonKernels;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+const MixKernels& MixKernels::best()
+{
+    static const MixKernels* chosen = []() {
+        const Isa order[] = { Isa::AVX2, Isa::NEON, Isa::SSE2 };
+        for (Isa isa : order)
+            if (const MixKernels* k = get(isa)) return k;
+        return &scalarKernels;
+    }();
+    return *chosen;
+}
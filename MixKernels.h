@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+
+// The mixer's inner loops. Each adds one voice into an interleaved stereo
+// float32 bus while its gain ramps linearly: frame i is scaled by
+// gain + i * step, so a gain change spread over a block never clicks. All
+// variants evaluate that expression in the same order, so on x86 they match
+// the scalar reference bit for bit. NEON builds may fuse the multiply-adds
+// and differ by up to TOLERANCE per voice at full scale.
+struct MixKernels
+{
+    enum class Isa { Scalar, SSE2, AVX2, NEON };
+
+    static constexpr float TOLERANCE = 1e-6f;
+
+    Isa isa;
+    const char* name;
+
+    // float32 planes; a mono voice passes the same plane twice
+    void (*planar)(const float* left, const float* right, uint32_t frames, float gain, float step, float* out);
+
+    // interleaved 16-bit PCM, any alignment; mono goes to both sides
+    void (*int16Stereo)(const uint8_t* in, uint32_t frames, float gain, float step, float* out);
+    void (*int16Mono)(const uint8_t* in, uint32_t frames, float gain, float step, float* out);
+
+    // the fastest set this build and CPU can run, picked on first use
+    static const MixKernels& best();
+
+    // nullptr when the build or the CPU does not support `isa`
+    static const MixKernels* get(Isa isa);
+};
@@ -0,0 +1,482 @@
+#include "Mixer.h"
+#include "RealtimeGuard.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+constexpr uint32_t Mixer::SAMPLE_RATE;
+constexpr int Mixer::CHANNELS;
+constexpr uint32_t Mixer::BLOCK_FRAMES;
+constexpr uint32_t Mixer::MAX_BLOCK_FRAMES;
+constexpr int Mixer::MAX_VOICES;
+
+// a handle is the pool index in the low byte and a generation above it, so
+// one that outlived its voice does not match the next voice in the slot
+static const uint32_t INDEX_BITS = 8;
+static_assert(Mixer::MAX_VOICES <= 1 << INDEX_BITS, "voice index does not fit a handle");
+
+namespace {
+
+struct Int16 {
+    static const int BYTES = 2;
+    static float load(const uint8_t* p) { int16_t v; memcpy(&v, p, 2); return v * (1.0f / 32768.0f); }
+};
+
+struct Int24 {
+    static const int BYTES = 3;
+    static float load(const uint8_t* p) {
+        int32_t v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+        return (v >> 8) * (1.0f / 8388608.0f);
+    }
+};
+
+struct Int32 {
+    static const int BYTES = 4;
+    static float load(const uint8_t* p) { int32_t v; memcpy(&v, p, 4); return v * (1.0f / 2147483648.0f); }
+};
+
+struct Float32 {
+    static const int BYTES = 4;
+    static float load(const uint8_t* p) { float v; memcpy(&v, p, 4); return v; }
+};
+
+// the formats without a MixKernels version, scalar only; frame i gets
+// gain + i * step like in the kernels
+template <typename T>
+void accumulate(const uint8_t* src, int channels, uint32_t frames, float gain, float step, float* out)
+{
+    if (channels == 2) {
+        for (uint32_t i = 0; i < frames; i++, src += 2 * T::BYTES)
+        {
+            float g = gain + (float)i * step;
+            out[2 * i] += T::load(src) * g;
+            out[2 * i + 1] += T::load(src + T::BYTES) * g;
+        }
+    } else {
+        // mono goes to both sides at full level
+        for (uint32_t i = 0; i < frames; i++, src += T::BYTES)
+        {
+            float v = T::load(src) * (gain + (float)i * step);
+            out[2 * i] += v;
+            out[2 * i + 1] += v;
+        }
+    }
+}
+
+int bytesPerSample(Mixer::Encoding encoding)
+{
+    switch (encoding) {
+    case Mixer::Encoding::Int16: return 2;
+    case Mixer::Encoding::Int24: return 3;
+    default: return 4;
+    }
+}
+
+// one frame as left and right, mono to both
+template <typename T>
+void loadFrame(const uint8_t* p, int channels, float* frame)
+{
+    frame[0] = T::load(p);
+    frame[1] = channels == 2 ? T::load(p + T::BYTES) : frame[0];
+}
+
+// Catmull-Rom through x[0..3], t of the way from x[1] to x[2]
+inline float cubic(float xm1, float x0, float x1, float x2, float t)
+{
+    float c1 = 0.5f * (x1 - xm1);
+    float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+    float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+    return ((c3 * t + c2) * t + c1) * t + x0;
+}
+
+}
+
+void Mixer::reset()
+{
+    while (voices.first() >= 0)
+        voices.release(voices.first());
+
+    masterGain = targetGain = 1.0f;
+    framesRendered = 0;
+    endedCount = 0;
+    timedBlocks = lateBlocks = renderNanos = deadlineNanos = worstNanos = 0;
+    worstLoad = 0.0;
+}
+
+uint32_t Mixer::play(const Source& source, float gain, uint32_t delay, uint32_t tag)
+{
+    int index = voices.acquire();
+    if (index < 0) return 0;
+
+    if (++generation >> (32 - INDEX_BITS)) generation = 1;
+
+    Voice& v = voices[index];
+    v = Voice();
+    v.id = generation << INDEX_BITS | (uint32_t)index;
+    v.tag = tag;
+    v.source = source;
+    v.gain = gain;
+    v.delay = delay;
+    v.segment = source.data;
+    v.segmentFrames = source.frames;
+    return v.id;
+}
+
+Mixer::Voice* Mixer::find(uint32_t voice)
+{
+    int index = (int)(voice & ((1u << INDEX_BITS) - 1));
+    if (!voices.isLive(index) || voices[index].id != voice) return nullptr;
+    return &voices[index];
+}
+
+void Mixer::end(Voice& v)
+{
+    // each voice ends once and leaves the list when removed, so it never
+    // holds more than the pool
+    v.done = true;
+    v.endedAt = endedCount;
+    ended[endedCount++] = v.id;
+}
+
+bool Mixer::finished(uint32_t voice)
+{
+    Voice* v = find(voice);
+    return !v || v->done;
+}
+
+void Mixer::remove(uint32_t voice)
+{
+    Voice* v = find(voice);
+    if (!v) return;
+
+    if (v->endedAt >= 0) {
+        uint32_t last = ended[--endedCount];
+        ended[v->endedAt] = last;
+        find(last)->endedAt = v->endedAt;
+    }
+    voices.release((int)(voice & ((1u << INDEX_BITS) - 1)));
+}
+
+void Mixer::fadeOut(uint32_t voice, uint32_t frames, uint32_t delay)
+{
+    Voice* v = find(voice);
+    if (!v || v->done) return;
+
+    // not audible yet, so nothing to ramp
+    if (v->delay > 0 && delay <= v->delay) {
+        end(*v);
+        return;
+    }
+
+    frames = std::max<uint32_t>(1, frames);
+    v->rampTarget = 0.0f;
+    v->gainStep = -v->gain / frames;
+    v->rampFrames = frames;
+    v->rampDelay = delay;
+    v->endAfterRamp = true;
+}
+
+void Mixer::glide(uint32_t voice, float rate, uint32_t frames)
+{
+    Voice* v = find(voice);
+    if (!v || v->done || v->source.generator) return;
+
+    // from here on the voice is read through the interpolator, starting
+    // exactly where the plain reader left it
+    if (!v->resampling) {
+        v->resampling = true;
+        v->primed = false;
+        v->phase = 0.0f;
+        v->rate = 1.0f;
+    }
+
+    frames = std::max<uint32_t>(1, frames);
+    v->rateTarget = std::min(std::max(rate, 0.25f), 4.0f);
+    v->rateFactor = (float)std::pow((double)v->rateTarget / v->rate, 1.0 / frames);
+    v->glideFrames = frames;
+}
+
+uint64_t Mixer::framesPlayed(uint32_t voice)
+{
+    Voice* v = find(voice);
+    return v ? v->played : 0;
+}
+
+void Mixer::setBlockFrames(uint32_t frames)
+{
+    blockSize = std::max<uint32_t>(1, std::min(frames, MAX_BLOCK_FRAMES));
+}
+
+void Mixer::setBlockCallback(void (*callback)(void*), void* context)
+{
+    blockCallback = callback;
+    blockContext = context;
+}
+
+void Mixer::setEndCallback(void (*callback)(uint32_t, uint32_t, uint64_t, void*), void* context)
+{
+    endCallback = callback;
+    endContext = context;
+}
+
+void Mixer::render(float* out, uint32_t frames)
+{
+    RealtimeGuard::Scope realtime;
+    auto start = std::chrono::steady_clock::now();
+
+    if (blockCallback) blockCallback(blockContext);
+
+    frames = std::min(frames, MAX_BLOCK_FRAMES);
+    memset(out, 0, frames * CHANNELS * sizeof(float));
+
+    // always in start order, so float sums come out the same every run
+    for (int i = voices.first(); i >= 0; i = voices.after(i))
+        if (!voices[i].done) mixVoice(voices[i], out, frames);
+
+    if (effect) effect->process(out, frames);
+
+    if (masterGain != 1.0f || targetGain != 1.0f) {
+        float step = (targetGain - masterGain) / frames;
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            float g = masterGain + (float)i * step;
+            out[2 * i] *= g;
+            out[2 * i + 1] *= g;
+        }
+        masterGain = targetGain;
+    }
+
+    // after mixing, so the callback can remove the voice it is given
+    while (endedCount > 0)
+    {
+        Voice* v = find(ended[--endedCount]);
+        v->endedAt = -1;
+        if (endCallback) endCallback(v->id, v->tag, v->played, endContext);
+    }
+
+    framesRendered.store(framesRendered.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+
+    uint64_t nanos = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    uint64_t deadline = (uint64_t)frames * 1000000000ull / SAMPLE_RATE;
+    double load = (double)nanos / deadline;
+
+    timedBlocks.store(timedBlocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    renderNanos.store(renderNanos.load(std::memory_order_relaxed) + nanos, std::memory_order_relaxed);
+    deadlineNanos.store(deadlineNanos.load(std::memory_order_relaxed) + deadline, std::memory_order_relaxed);
+    if (nanos > deadline) lateBlocks.store(lateBlocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (nanos > worstNanos.load(std::memory_order_relaxed)) worstNanos.store(nanos, std::memory_order_relaxed);
+    if (load > worstLoad.load(std::memory_order_relaxed)) worstLoad.store(load, std::memory_order_relaxed);
+}
+
+Mixer::Timing Mixer::timing() const
+{
+    Timing t;
+    t.blocks = timedBlocks.load(std::memory_order_relaxed);
+    t.late = lateBlocks.load(std::memory_order_relaxed);
+
+    unsigned long long deadline = deadlineNanos.load(std::memory_order_relaxed);
+    t.averageLoad = deadline ? (double)renderNanos.load(std::memory_order_relaxed) / deadline : 0.0;
+    t.worstLoad = worstLoad.load(std::memory_order_relaxed);
+    t.worstSeconds = worstNanos.load(std::memory_order_relaxed) * 1e-9;
+    return t;
+}
+
+bool Mixer::nextSegment(Voice& v, uint32_t wanted)
+{
+    const Source& src = v.source;
+
+    // only as much as the block still needs, so it is all mixed before the
+    // next voice overwrites it
+    if (src.generator) {
+        v.segmentFrames = src.generator->generate(generated, wanted);
+        v.position = 0;
+        if (v.segmentFrames == 0) {
+            end(v);
+            return false;
+        }
+        return true;
+    }
+
+    if (v.holdingChunk) {
+        src.streamer->release(src.stream);
+        v.holdingChunk = false;
+    }
+
+    if (!src.stream || src.streamer->finished(src.stream)) {
+        end(v);
+        return false;
+    }
+
+    SampleStreamer::Chunk chunk;
+    if (!src.streamer->next(src.stream, chunk)) {
+        // count each dropout once, not every block it lasts
+        if (!v.starved) streamUnderruns++;
+        v.starved = true;
+        return false;
+    }
+
+    v.starved = false;
+    v.inStream = true;
+    v.holdingChunk = true;
+    v.segment = chunk.data;
+    v.segmentFrames = chunk.bytes / (bytesPerSample(src.encoding) * src.channels);
+    v.position = 0;
+    return true;
+}
+
+int Mixer::fetch(Voice& v, float* frame)
+{
+    // 1 with the next source frame, 0 while the stream is starved, -1 once
+    // the source has ended
+    if (v.done) return -1;
+    if (v.position >= v.segmentFrames && !nextSegment(v, 0))
+        return v.done ? -1 : 0;
+
+    const Source& src = v.source;
+    if (!v.inStream && src.planar[0]) {
+        frame[0] = src.planar[0][v.position];
+        frame[1] = src.planar[src.channels == 2 ? 1 : 0][v.position];
+    } else {
+        const uint8_t* p = v.segment + (size_t)v.position * bytesPerSample(src.encoding) * src.channels;
+        switch (src.encoding) {
+        case Encoding::Int16: loadFrame<Int16>(p, src.channels, frame); break;
+        case Encoding::Int24: loadFrame<Int24>(p, src.channels, frame); break;
+        case Encoding::Int32: loadFrame<Int32>(p, src.channels, frame); break;
+        case Encoding::Float32: loadFrame<Float32>(p, src.channels, frame); break;
+        }
+    }
+    v.position++;
+    return 1;
+}
+
+uint32_t Mixer::resample(Voice& v, float* out, uint32_t frames, float gain, float step)
+{
+    float frame[2];
+
+    // the window starts on the frame the plain reader would have played next
+    if (!v.primed) {
+        if (fetch(v, frame) != 1) return 0;
+        for (int k = 0; k < 2; k++)
+            v.window[0][k] = v.window[1][k] = frame[k];
+        for (int j = 2; j < 4; j++)
+        {
+            if (fetch(v, frame) != 1) frame[0] = frame[1] = 0.0f;
+            v.window[j][0] = frame[0];
+            v.window[j][1] = frame[1];
+        }
+        v.primed = true;
+    }
+
+    // in locals, as the stores to out could alias the voice
+    float w[4][2];
+    memcpy(w, v.window, sizeof(w));
+    float phase = v.phase, rate = v.rate;
+    uint32_t glideFrames = v.glideFrames;
+    uint32_t i = 0;
+
+    for (; i < frames; i++)
+    {
+        bool dry = false;
+        while (phase >= 1.0f)
+        {
+            int got = fetch(v, frame);
+            if (got == 0 || (got < 0 && ++v.drained > 2)) {
+                dry = true;
+                break;
+            }
+            // play out what the window still holds
+            if (got < 0) frame[0] = frame[1] = 0.0f;
+
+            w[0][0] = w[1][0]; w[0][1] = w[1][1];
+            w[1][0] = w[2][0]; w[1][1] = w[2][1];
+            w[2][0] = w[3][0]; w[2][1] = w[3][1];
+            w[3][0] = frame[0]; w[3][1] = frame[1];
+            phase -= 1.0f;
+        }
+        if (dry) break;
+
+        float g = gain + (float)i * step;
+        out[2 * i] += cubic(w[0][0], w[1][0], w[2][0], w[3][0], phase) * g;
+        out[2 * i + 1] += cubic(w[0][1], w[1][1], w[2][1], w[3][1], phase) * g;
+
+        phase += rate;
+        if (glideFrames > 0)
+            rate = --glideFrames > 0 ? rate * v.rateFactor : v.rateTarget;
+    }
+
+    memcpy(v.window, w, sizeof(w));
+    v.phase = phase;
+    v.rate = rate;
+    v.glideFrames = glideFrames;
+    return i;
+}
+
+void Mixer::mixVoice(Voice& v, float* out, uint32_t frames)
+{
+    const Source& src = v.source;
+
+    // a voice that starts later in the block, or in a later one
+    uint32_t written = std::min(v.delay, frames);
+    v.delay -= written;
+    v.rampDelay -= std::min(v.rampDelay, written);
+
+    while (written < frames)
+    {
+        if (!v.resampling && v.position >= v.segmentFrames && !nextSegment(v, frames - written))
+            break;
+
+        uint32_t n = v.resampling ? frames - written : std::min(frames - written, v.segmentFrames - v.position);
+        float step = 0.0f;
+        if (v.rampDelay > 0) {
+            n = std::min(n, v.rampDelay);
+        } else if (v.rampFrames > 0) {
+            n = std::min(n, v.rampFrames);
+            step = v.gainStep;
+        }
+
+        float* dst = out + written * CHANNELS;
+        bool cut = false;
+
+        if (v.resampling) {
+            // reads the source itself, and stops early where it runs dry
+            uint32_t got = resample(v, dst, n, v.gain, step);
+            cut = got < n;
+            n = got;
+        } else if (src.generator) {
+            kernels->planar(generated + v.position, generated + v.position, n, v.gain, step, dst);
+        } else if (!v.inStream && src.planar[0]) {
+            const float* right = src.planar[src.channels == 2 ? 1 : 0];
+            kernels->planar(src.planar[0] + v.position, right + v.position, n, v.gain, step, dst);
+        } else {
+            const uint8_t* p = v.segment + (size_t)v.position * bytesPerSample(src.encoding) * src.channels;
+            switch (src.encoding) {
+            case Encoding::Int16:
+                if (src.channels == 2) kernels->int16Stereo(p, n, v.gain, step, dst);
+                else kernels->int16Mono(p, n, v.gain, step, dst);
+                break;
+            case Encoding::Int24: accumulate<Int24>(p, src.channels, n, v.gain, step, dst); break;
+            case Encoding::Int32: accumulate<Int32>(p, src.channels, n, v.gain, step, dst); break;
+            case Encoding::Float32: accumulate<Float32>(p, src.channels, n, v.gain, step, dst); break;
+            }
+        }
+
+        if (!v.resampling) v.position += n;
+        v.played += n;
+        written += n;
+
+        if (v.rampDelay > 0) {
+            v.rampDelay -= n;
+        } else if (v.rampFrames > 0) {
+            v.rampFrames -= n;
+            v.gain = v.rampFrames > 0 ? v.gain + (float)n * step : v.rampTarget;
+
+            if (v.rampFrames == 0 && v.endAfterRamp) {
+                if (!v.done) end(v);
+                break;
+            }
+        }
+
+        if (cut) break;
+    }
+}
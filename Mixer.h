@@ -0,0 +1,215 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include "SampleStreamer.h"
+#include "VoicePool.h"
+#include "MixKernels.h"
+
+// Sums the playing voices into fixed-size blocks of interleaved stereo
+// float32. The output only depends on the voices started and the order the
+// blocks are pulled in, so two runs can be compared sample for sample.
+// Voices are owned by the thread that renders: play(), finished() and
+// remove() have to be called from there, normally from the block or end
+// callback.
+class Mixer
+{
+public:
+    static constexpr uint32_t SAMPLE_RATE = 44100;
+    static constexpr int CHANNELS = 2;
+    static constexpr uint32_t BLOCK_FRAMES = 256; // default block size
+    static constexpr uint32_t MAX_BLOCK_FRAMES = 4096;
+    static constexpr int MAX_VOICES = 64;
+
+    enum class Encoding { Int16, Int24, Int32, Float32 };
+
+    // produces a voice's frames on the fly instead of reading stored ones
+    class Generator
+    {
+    public:
+        virtual ~Generator() = default;
+
+        // writes up to `frames` mono float32 frames, at most MAX_BLOCK_FRAMES,
+        // and returns how many; 0 ends the voice. Called on the rendering
+        // thread, so it must not allocate or block
+        virtual uint32_t generate(float* out, uint32_t frames) = 0;
+    };
+
+    // changes the summed output of every voice, before the gain
+    class Effect
+    {
+    public:
+        virtual ~Effect() = default;
+
+        // interleaved stereo, in place, at most MAX_BLOCK_FRAMES frames.
+        // Called on the rendering thread, so it must not allocate or block
+        virtual void process(float* out, uint32_t frames) = 0;
+    };
+
+    // what a voice plays; all of it has to stay valid until the voice is removed
+    struct Source {
+        const uint8_t* data = nullptr; // interleaved frames, mono or stereo
+        uint32_t frames = 0;
+        int channels = 0;
+        Encoding encoding = Encoding::Int16;
+        const float* planar[2] = {};   // the same frames as float32 planes, used when set
+
+        // continues with the chunks of this stream once data runs out
+        SampleStreamer* streamer = nullptr;
+        SampleStreamer::Stream* stream = nullptr;
+
+        // replaces all of the above when set; mono, to both sides
+        Generator* generator = nullptr;
+    };
+
+    // drops every voice and restarts the clock at 0
+    void reset();
+
+    // returns a handle for finished() and remove(), 0 when all MAX_VOICES
+    // are taken; neither allocates. The voice stays silent for the first
+    // `delay` frames of the following renders, so it can start on any frame.
+    // `tag` is handed back to the end callback
+    uint32_t play(const Source& source, float gain, uint32_t delay = 0, uint32_t tag = 0);
+    bool finished(uint32_t voice);
+    void remove(uint32_t voice);
+
+    // ramps the voice linearly down to silence over `frames` frames, starting
+    // `delay` frames into the following renders; it counts as finished after
+    void fadeOut(uint32_t voice, uint32_t frames, uint32_t delay = 0);
+
+    // moves the voice's playback rate to `rate` over `frames` frames, by the
+    // same ratio every frame so the pitch slides evenly; 2 plays an octave
+    // up. From the first glide on the voice is read through a cubic
+    // interpolator, scalar only. Generator voices keep their rate
+    void glide(uint32_t voice, float rate, uint32_t frames);
+
+    // frames of the voice mixed so far
+    uint64_t framesPlayed(uint32_t voice);
+
+    // applied to the summed output of every voice, ramped in across the
+    // next block
+    void setGain(float gain) { targetGain = gain; }
+
+    // nullptr for none; set while no backend is rendering
+    void setEffect(Effect* e) { effect = e; }
+
+    // the SIMD kernels picked for this CPU unless replaced
+    void setKernels(const MixKernels& k) { kernels = &k; }
+    const MixKernels& mixKernels() const { return *kernels; }
+
+    // called on the rendering thread at the start of every render(), before
+    // anything is mixed, so voices can be started and stopped from there
+    void setBlockCallback(void (*callback)(void*), void* context);
+
+    // called on the rendering thread at the end of the render() a voice ends
+    // in, once per voice, with its tag and the frames it played; the voice
+    // stays until remove(), which the callback may call
+    void setEndCallback(void (*callback)(uint32_t voice, uint32_t tag, uint64_t played, void*), void* context);
+
+    // the frames backends pull per render(), BLOCK_FRAMES unless changed;
+    // set before a backend opens
+    void setBlockFrames(uint32_t frames);
+    uint32_t blockFrames() const { return blockSize; }
+
+    // backend side: mixes the next `frames` frames, at most MAX_BLOCK_FRAMES,
+    // into out; voices started in between begin exactly at the following frame
+    void render(float* out, uint32_t frames);
+    void render(float* out) { render(out, blockSize); }
+
+    // frames rendered so far; inside the block callback, the frame the
+    // coming block starts on
+    uint64_t clock() const { return framesRendered.load(std::memory_order_relaxed); }
+
+    size_t voiceCount() const { return (size_t)voices.size(); }
+    unsigned long long underruns() const { return streamUnderruns; }
+
+    // wall-clock cost of render(), callbacks included, against the real-time
+    // length of the frames it produced; a late block would have dropped out
+    // on a device running this close to the deadline
+    struct Timing {
+        unsigned long long blocks = 0;
+        unsigned long long late = 0;
+        double averageLoad = 0.0; // render time over block length
+        double worstLoad = 0.0;
+        double worstSeconds = 0.0;
+    };
+    Timing timing() const;
+
+private:
+    struct Voice {
+        uint32_t id = 0;
+        uint32_t tag = 0;
+        int endedAt = -1; // index in ended until reported
+        Source source;
+        float gain = 1.0f;
+        uint32_t delay = 0; // silent frames before the first one
+
+        // linear ramp: after rampDelay frames, gain moves by gainStep per frame
+        // for rampFrames more frames, then lands on rampTarget; the voice ends
+        // there if endAfterRamp
+        uint32_t rampDelay = 0;
+        float gainStep = 0.0f;
+        float rampTarget = 0.0f;
+        uint32_t rampFrames = 0;
+        bool endAfterRamp = false;
+        uint64_t played = 0;
+
+        // the segment being read: the resident frames first, then stream chunks
+        const uint8_t* segment = nullptr;
+        uint32_t segmentFrames = 0;
+        uint32_t position = 0;
+        bool inStream = false;
+        bool holdingChunk = false;
+        bool starved = false;
+        bool done = false;
+
+        // once glided: the output sits `phase` of the way from window[1] to
+        // window[2], the source frames around it; rate is multiplied by
+        // rateFactor each frame for glideFrames more, then is rateTarget
+        bool resampling = false;
+        bool primed = false;
+        float window[4][2] = {};
+        float phase = 0.0f;
+        float rate = 1.0f;
+        float rateTarget = 1.0f;
+        float rateFactor = 1.0f;
+        uint32_t glideFrames = 0;
+        int drained = 0; // frames of silence shifted in after the source ended
+    };
+
+    Voice* find(uint32_t voice);
+    void end(Voice& v);
+    bool nextSegment(Voice& v, uint32_t wanted);
+    int fetch(Voice& v, float* frame);
+    uint32_t resample(Voice& v, float* out, uint32_t frames, float gain, float step);
+    void mixVoice(Voice& v, float* out, uint32_t frames);
+
+    VoicePool<Voice, MAX_VOICES> voices;
+    uint32_t generation = 0;
+    uint32_t blockSize = BLOCK_FRAMES;
+    float masterGain = 1.0f;
+    float targetGain = 1.0f;
+    Effect* effect = nullptr;
+    const MixKernels* kernels = &MixKernels::best();
+    std::atomic<uint64_t> framesRendered{ 0 };
+    void (*blockCallback)(void*) = nullptr;
+    void* blockContext = nullptr;
+    void (*endCallback)(uint32_t, uint32_t, uint64_t, void*) = nullptr;
+    void* endContext = nullptr;
+
+    // what generators wrote for the voice being mixed
+    float generated[MAX_BLOCK_FRAMES];
+
+    // live voices that ended and are not reported yet
+    uint32_t ended[MAX_VOICES] = {};
+    int endedCount = 0;
+    std::atomic<unsigned long long> streamUnderruns{ 0 };
+
+    // written by the rendering thread only
+    std::atomic<unsigned long long> timedBlocks{ 0 };
+    std::atomic<unsigned long long> lateBlocks{ 0 };
+    std::atomic<unsigned long long> renderNanos{ 0 };
+    std::atomic<unsigned long long> deadlineNanos{ 0 };
+    std::atomic<unsigned long long> worstNanos{ 0 };
+    std::atomic<double> worstLoad{ 0.0 };
+};
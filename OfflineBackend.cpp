@@ -0,0 +1,90 @@
+#include "OfflineBackend.h"
+#include "Mixer.h"
+#include "WavParser.h"
+#include <algorithm>
+#include <chrono>
+
+OfflineBackend::OfflineBackend(const std::string& wavPath)
+    : path(wavPath)
+{
+}
+
+bool OfflineBackend::open(Mixer& source)
+{
+    mixer = &source;
+    block.assign(source.blockFrames() * Mixer::CHANNELS, 0.0f);
+    framesRendered = 0;
+    renderSeconds = 0.0;
+
+    if (path.empty()) return true;
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    // sizes are patched in once the length is known
+    writeHeader(0);
+    return (bool)file;
+}
+
+void OfflineBackend::close()
+{
+    if (file.is_open()) {
+        file.seekp(0);
+        writeHeader(framesRendered * Mixer::CHANNELS * sizeof(float));
+        file.close();
+    }
+
+    mixer = nullptr;
+}
+
+void OfflineBackend::advance(uint64_t frames)
+{
+    if (!mixer) return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (frames > 0)
+    {
+        uint32_t n = (uint32_t)std::min<uint64_t>(frames, mixer->blockFrames());
+        mixer->render(block.data(), n);
+
+        if (file.is_open())
+            file.write((const char*)block.data(), (std::streamsize)(n * Mixer::CHANNELS * sizeof(float)));
+
+        framesRendered += n;
+        frames -= n;
+    }
+
+    renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double OfflineBackend::realTimeFactor() const
+{
+    if (renderSeconds <= 0.0) return 0.0;
+    return (double)framesRendered / Mixer::SAMPLE_RATE / renderSeconds;
+}
+
+static void put16(std::ofstream& f, uint16_t v) { f.write((const char*)&v, 2); }
+static void put32(std::ofstream& f, uint32_t v) { f.write((const char*)&v, 4); }
+
+void OfflineBackend::writeHeader(uint64_t dataBytes)
+{
+    uint32_t data = (uint32_t)std::min<uint64_t>(dataBytes, 0xFFFFFFFFu - 36);
+    const uint16_t blockAlign = Mixer::CHANNELS * sizeof(float);
+
+    file.write("RIFF", 4);
+    put32(file, 36 + data);
+    file.write("WAVE", 4);
+
+    file.write("fmt ", 4);
+    put32(file, 16);
+    put16(file, WavInfo::FORMAT_IEEE_FLOAT);
+    put16(file, Mixer::CHANNELS);
+    put32(file, Mixer::SAMPLE_RATE);
+    put32(file, Mixer::SAMPLE_RATE * blockAlign);
+    put16(file, blockAlign);
+    put16(file, 32);
+
+    file.write("data", 4);
+    put32(file, data);
+}
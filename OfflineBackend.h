@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "AudioBackend.h"
+
+// Renders the mixer output on the calling thread against a virtual clock,
+// as fast as the CPU allows, into a 32-bit float WAV file or nowhere.
+class OfflineBackend : public AudioBackend
+{
+public:
+    // an empty path discards the output
+    explicit OfflineBackend(const std::string& wavPath = "");
+
+    bool open(Mixer& mixer) override;
+    void close() override;
+    const char* name() const override { return "offline"; }
+
+    // renders the next `frames` frames; notes played afterwards start at
+    // exactly the new clock position
+    void advance(uint64_t frames);
+    uint64_t clock() const { return framesRendered; }
+
+    // seconds of audio rendered per second of wall-clock time spent rendering
+    double realTimeFactor() const;
+
+private:
+    void writeHeader(uint64_t dataBytes);
+
+    Mixer* mixer = nullptr;
+    std::string path;
+    std::ofstream file;
+    std::vector<float> block;
+    uint64_t framesRendered = 0;
+    double renderSeconds = 0.0;
+};
@@ -0,0 +1,121 @@
+#include "PlanarSamples.h"
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PLANARSAMPLES_SSE2
+#include <emmintrin.h>
+#endif
+
+constexpr size_t PlanarSamples::ALIGNMENT;
+constexpr uint32_t PlanarSamples::PADDING;
+
+static const float INT16_SCALE = 1.0f / 32768.0f;
+
+bool PlanarSamples::convert(const uint8_t* interleaved, uint32_t frameCount, int channelCount,
+    int bitsPerSample, bool isFloat)
+{
+    clear();
+    if (channelCount < 1 || channelCount > 2 || frameCount == 0) return false;
+    if (isFloat ? bitsPerSample != 32 : (bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32))
+        return false;
+
+    const size_t floatsPerLine = ALIGNMENT / sizeof(float);
+    stride = (frameCount + PADDING + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+
+    // room to slide the start up to the next alignment boundary
+    storage.assign(stride * channelCount + floatsPerLine, 0.0f);
+    uintptr_t raw = (uintptr_t)storage.data();
+    base = (float*)((raw + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+    frames = frameCount;
+    channels = channelCount;
+
+    float* out[2] = { base, base + stride };
+
+    if (bitsPerSample == 16) {
+        int16ToPlanar((const int16_t*)interleaved, frames, channels, out);
+        return true;
+    }
+
+    int bytes = bitsPerSample / 8;
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            const uint8_t* p = interleaved + ((size_t)i * channels + c) * bytes;
+            float v;
+
+            if (isFloat) {
+                memcpy(&v, p, 4);
+            } else if (bytes == 3) {
+                int32_t s = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+                v = (float)(s >> 8) * (1.0f / 8388608.0f);
+            } else {
+                int32_t s;
+                memcpy(&s, p, 4);
+                v = (float)s * (1.0f / 2147483648.0f);
+            }
+
+            out[c][i] = v;
+        }
+    }
+
+    return true;
+}
+
+void PlanarSamples::swap(PlanarSamples& other)
+{
+    storage.swap(other.storage);
+    std::swap(base, other.base);
+    std::swap(stride, other.stride);
+    std::swap(frames, other.frames);
+    std::swap(channels, other.channels);
+}
+
+void PlanarSamples::clear()
+{
+    std::vector<float>().swap(storage);
+    base = nullptr;
+    stride = 0;
+    frames = 0;
+    channels = 0;
+}
+
+void PlanarSamples::int16ToPlanar(const int16_t* in, uint32_t frames, int channels, float* const* out, bool simd)
+{
+    uint32_t i = 0;
+
+#ifdef PLANARSAMPLES_SSE2
+    if (simd)
+    {
+        const __m128 scale = _mm_set1_ps(INT16_SCALE);
+
+        if (channels == 2) {
+            // 4 stereo frames per load; left is the low half of each 32-bit pair
+            for (; i + 4 <= frames; i += 4)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(in + 2 * i));
+                __m128i left = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+                __m128i right = _mm_srai_epi32(v, 16);
+
+                _mm_storeu_ps(out[0] + i, _mm_mul_ps(_mm_cvtepi32_ps(left), scale));
+                _mm_storeu_ps(out[1] + i, _mm_mul_ps(_mm_cvtepi32_ps(right), scale));
+            }
+        } else {
+            for (; i + 8 <= frames; i += 8)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+                _mm_storeu_ps(out[0] + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+                _mm_storeu_ps(out[0] + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+            }
+        }
+    }
+#endif
+
+    for (; i < frames; i++)
+        for (int c = 0; c < channels; c++)
+            out[c][i] = in[(size_t)i * channels + c] * INT16_SCALE;
+}
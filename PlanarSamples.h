@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// A sample converted once to planar float32 for in-process mixing. Every
+// channel starts on an ALIGNMENT boundary and is followed by PADDING zeroed
+// frames, so vector loads may run past the last frame without checks.
+class PlanarSamples
+{
+public:
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr uint32_t PADDING = 16;
+
+    PlanarSamples() = default;
+    PlanarSamples(PlanarSamples&& other) { swap(other); }
+    PlanarSamples& operator=(PlanarSamples&& other) { swap(other); return *this; }
+
+    PlanarSamples(const PlanarSamples&) = delete;
+    PlanarSamples& operator=(const PlanarSamples&) = delete;
+
+    void swap(PlanarSamples& other);
+
+    // interleaved PCM in; 16, 24 and 32-bit integer or 32-bit float
+    bool convert(const uint8_t* interleaved, uint32_t frames, int channels, int bitsPerSample, bool isFloat);
+    void clear();
+
+    bool empty() const { return frames == 0; }
+    uint32_t frameCount() const { return frames; }
+    int channelCount() const { return channels; }
+    const float* channel(int c) const { return base + (size_t)c * stride; }
+    size_t bytes() const { return storage.size() * sizeof(float); }
+
+    // the SIMD kernel used by convert for 16-bit input, exposed for benchmarks
+    static void int16ToPlanar(const int16_t* in, uint32_t frames, int channels, float* const* out, bool simd = true);
+
+private:
+    std::vector<float> storage;
+    float* base = nullptr;
+    size_t stride = 0;
+    uint32_t frames = 0;
+    int channels = 0;
+};
@@ -0,0 +1,108 @@
+#include "RealtimeGuard.h"
+
+#if REALTIME_GUARD
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <dbghelp.h>
+#pragma comment(lib, "dbghelp.lib")
+#elif defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+// reports beyond this are only counted
+static const unsigned long long MAX_REPORTS = 8;
+
+static thread_local int realtimeDepth = 0;
+static std::atomic<unsigned long long> violationCount{ 0 };
+
+RealtimeGuard::Scope::Scope()
+{
+    realtimeDepth++;
+}
+
+RealtimeGuard::Scope::~Scope()
+{
+    realtimeDepth--;
+}
+
+static void printStackTrace()
+{
+#ifdef _WIN32
+    void* frames[32];
+    USHORT count = CaptureStackBackTrace(2, 32, frames, nullptr);
+
+    HANDLE process = GetCurrentProcess();
+    static bool symbolsLoaded = SymInitialize(process, nullptr, TRUE) != FALSE;
+
+    alignas(SYMBOL_INFO) char buffer[sizeof(SYMBOL_INFO) + 256];
+    SYMBOL_INFO* symbol = (SYMBOL_INFO*)buffer;
+    for (USHORT i = 0; i < count; i++)
+    {
+        symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+        symbol->MaxNameLen = 255;
+        DWORD64 address = (DWORD64)frames[i];
+        if (symbolsLoaded && SymFromAddr(process, address, nullptr, symbol))
+            fprintf(stderr, "    %s\n", symbol->Name);
+        else
+            fprintf(stderr, "    0x%llx\n", (unsigned long long)address);
+    }
+#elif defined(__GLIBC__)
+    // writes straight to the fd, without allocating
+    void* frames[32];
+    int count = backtrace(frames, 32);
+    backtrace_symbols_fd(frames + 2, count > 2 ? count - 2 : 0, 2);
+#else
+    fprintf(stderr, "    (no stack trace on this platform)\n");
+#endif
+}
+
+void RealtimeGuard::blocking(const char* what)
+{
+    if (realtimeDepth <= 0) return;
+
+    unsigned long long n = ++violationCount;
+    if (n > MAX_REPORTS) return;
+
+    // the report itself may allocate; that is not the audio path's doing
+    int depth = realtimeDepth;
+    realtimeDepth = 0;
+
+    fprintf(stderr, "Real-time violation #%llu: %s on the audio thread\n", n, what);
+    printStackTrace();
+    if (n == MAX_REPORTS) fprintf(stderr, "Further real-time violations are only counted\n");
+
+    realtimeDepth = depth;
+}
+
+unsigned long long RealtimeGuard::violations()
+{
+    return violationCount.load();
+}
+
+// the replaceable global allocation functions; the array and nothrow forms
+// end up in these
+void* operator new(std::size_t size)
+{
+    RealtimeGuard::blocking("heap allocation");
+
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p) RealtimeGuard::blocking("heap free");
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+// Debug check that the audio thread never does anything that can stall it.
+// With REALTIME_GUARD set (the default in _DEBUG builds), every heap
+// allocation or free, and every call to blocking(), made while a Scope is
+// alive on the current thread is counted and the first few are reported on
+// stderr with a stack trace. Without it, all of this compiles to nothing.
+#if !defined(REALTIME_GUARD) && defined(_DEBUG)
+#define REALTIME_GUARD 1
+#endif
+
+class RealtimeGuard
+{
+public:
+    // marks the current thread as real-time until destroyed; nests
+    class Scope
+    {
+    public:
+#if REALTIME_GUARD
+        Scope();
+        ~Scope();
+#else
+        Scope() {}
+#endif
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // called right before anything that may block: taking a lock, waiting,
+    // file I/O. `what` names it in the report
+#if REALTIME_GUARD
+    static void blocking(const char* what);
+    static unsigned long long violations();
+    static constexpr bool enabled = true;
+#else
+    static void blocking(const char*) {}
+    static unsigned long long violations() { return 0; }
+    static constexpr bool enabled = false;
+#endif
+};
@@ -0,0 +1,103 @@
+#include "Resampler.h"
+#include <cmath>
+
+constexpr int Resampler::PHASES;
+constexpr int Resampler::TAPS;
+
+static const double PI = 3.14159265358979323846;
+static const double KAISER_BETA = 9.0;
+
+// zeroth order modified Bessel function, for the Kaiser window
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+Resampler::Resampler(double ratio)
+    : ratio(ratio), table((PHASES + 1) * TAPS)
+{
+    // lowpass at the lower of the two Nyquist rates, with a little margin
+    double cutoff = (ratio > 1.0 ? 1.0 / ratio : 1.0) * 0.97;
+    double half = TAPS / 2.0;
+    double norm = besselI0(KAISER_BETA);
+
+    for (int p = 0; p <= PHASES; p++)
+    {
+        float* row = &table[p * TAPS];
+        double frac = (double)p / PHASES;
+        double sum = 0.0;
+
+        for (int k = 0; k < TAPS; k++)
+        {
+            // distance from the output position to input sample i + k - (TAPS / 2 - 1)
+            double x = k - (half - 1.0) - frac;
+            double sinc = x == 0.0 ? 1.0 : std::sin(PI * cutoff * x) / (PI * cutoff * x);
+            double w = x / half;
+            double window = std::fabs(w) >= 1.0 ? 0.0 : besselI0(KAISER_BETA * std::sqrt(1.0 - w * w)) / norm;
+
+            row[k] = (float)(cutoff * sinc * window);
+            sum += row[k];
+        }
+
+        // unity gain at DC for every phase
+        for (int k = 0; k < TAPS; k++)
+            row[k] = (float)(row[k] / sum);
+    }
+}
+
+double Resampler::semitoneRatio(int semitones)
+{
+    return std::pow(2.0, semitones / 12.0);
+}
+
+uint32_t Resampler::outputFrames(uint32_t inputFrames) const
+{
+    if (inputFrames == 0) return 0;
+    return (uint32_t)((inputFrames - 1) / ratio) + 1;
+}
+
+void Resampler::process(const int16_t* in, uint32_t inputFrames, int channels, int16_t* out) const
+{
+    uint32_t frames = outputFrames(inputFrames);
+    const int lead = TAPS / 2 - 1;
+    float coef[TAPS];
+
+    for (uint32_t n = 0; n < frames; n++)
+    {
+        double t = n * ratio;
+        long long i = (long long)t;
+        double pos = (t - (double)i) * PHASES;
+        int p = (int)pos;
+        float a = (float)(pos - p);
+
+        const float* r0 = &table[p * TAPS];
+        const float* r1 = r0 + TAPS;
+        for (int k = 0; k < TAPS; k++)
+            coef[k] = r0[k] + a * (r1[k] - r0[k]);
+
+        long long first = i - lead;
+        int kBegin = first < 0 ? (int)-first : 0;
+        int kEnd = first + TAPS > (long long)inputFrames ? (int)((long long)inputFrames - first) : TAPS;
+
+        for (int c = 0; c < channels; c++)
+        {
+            const int16_t* src = in + (first + kBegin) * channels + c;
+            float acc = 0.0f;
+
+            // samples outside the input count as silence
+            for (int k = kBegin; k < kEnd; k++, src += channels)
+                acc += coef[k] * *src;
+
+            long v = std::lround(acc);
+            out[(size_t)n * channels + c] = (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+        }
+    }
+}
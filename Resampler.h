@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Windowed-sinc polyphase resampler that plays a sample back at a fixed
+// rate ratio, i.e. shifts its pitch. The filter bank holds PHASES sub-filters
+// of TAPS taps; positions between two phases interpolate their coefficients.
+// The cutoff follows the ratio, so shifting up does not alias.
+class Resampler
+{
+public:
+    static constexpr int PHASES = 256;
+    static constexpr int TAPS = 32;
+
+    // ratio > 1 raises the pitch (and shortens the sample)
+    explicit Resampler(double ratio);
+
+    static double semitoneRatio(int semitones);
+
+    double rate() const { return ratio; }
+    uint32_t outputFrames(uint32_t inputFrames) const;
+
+    // interleaved 16-bit in and out, out must hold outputFrames(inputFrames) frames
+    void process(const int16_t* in, uint32_t inputFrames, int channels, int16_t* out) const;
+
+private:
+    double ratio;
+    std::vector<float> table; // (PHASES + 1) rows of TAPS coefficients
+};
@@ -0,0 +1,104 @@
+#include "SampleAnalysis.h"
+#include <cmath>
+#include <cstring>
+
+static float readSample(const uint8_t* p, int bytes, bool isFloat)
+{
+    if (isFloat) {
+        float v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+    if (bytes == 2) {
+        int16_t v;
+        memcpy(&v, p, 2);
+        return v * (1.0f / 32768.0f);
+    }
+    if (bytes == 3) {
+        int32_t v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+        return (v >> 8) * (1.0f / 8388608.0f);
+    }
+
+    int32_t v;
+    memcpy(&v, p, 4);
+    return v * (1.0f / 2147483648.0f);
+}
+
+static void writeSample(uint8_t* p, int bytes, bool isFloat, float v)
+{
+    if (isFloat) {
+        memcpy(p, &v, 4);
+    } else if (bytes == 2) {
+        int16_t s = (int16_t)std::lround(v * 32767.0f);
+        memcpy(p, &s, 2);
+    } else if (bytes == 3) {
+        int32_t s = (int32_t)std::lround(v * 8388607.0f);
+        p[0] = (uint8_t)s;
+        p[1] = (uint8_t)(s >> 8);
+        p[2] = (uint8_t)(s >> 16);
+    } else {
+        int32_t s = (int32_t)std::lround((double)v * 2147483647.0);
+        memcpy(p, &s, 4);
+    }
+}
+
+TailAnalysis analyzeTail(const uint8_t* data, uint32_t frames, int channels, int bitsPerSample,
+    bool isFloat, uint32_t windowFrames, float thresholdDb)
+{
+    TailAnalysis result;
+    result.windowFrames = windowFrames;
+    if (windowFrames == 0 || channels < 1) return result;
+
+    int bytes = bitsPerSample / 8;
+    size_t frameBytes = (size_t)bytes * channels;
+
+    for (uint32_t start = 0; start < frames; start += windowFrames)
+    {
+        uint32_t n = frames - start < windowFrames ? frames - start : windowFrames;
+        double loudest = 0.0;
+
+        for (int c = 0; c < channels; c++)
+        {
+            double sum = 0.0;
+            const uint8_t* p = data + start * frameBytes + (size_t)c * bytes;
+            for (uint32_t i = 0; i < n; i++, p += frameBytes)
+            {
+                float v = readSample(p, bytes, isFloat);
+                sum += (double)v * v;
+            }
+
+            double mean = sum / n;
+            if (mean > loudest) loudest = mean;
+        }
+
+        // 10 * log10 of the mean square is the RMS level in dB
+        float db = loudest > 0.0 ? (float)(10.0 * std::log10(loudest)) : -200.0f;
+        result.envelopeDb.push_back(db);
+
+        if (db >= thresholdDb)
+            result.audibleFrames = start + n;
+    }
+
+    return result;
+}
+
+void fadeOutTail(uint8_t* data, uint32_t frames, uint32_t fadeFrames, int channels, int bitsPerSample, bool isFloat)
+{
+    if (fadeFrames > frames) fadeFrames = frames;
+
+    int bytes = bitsPerSample / 8;
+    size_t frameBytes = (size_t)bytes * channels;
+    uint32_t start = frames - fadeFrames;
+
+    for (uint32_t i = 0; i < fadeFrames; i++)
+    {
+        float gain = (float)(fadeFrames - 1 - i) / fadeFrames;
+        uint8_t* frame = data + (size_t)(start + i) * frameBytes;
+
+        for (int c = 0; c < channels; c++)
+        {
+            uint8_t* p = frame + (size_t)c * bytes;
+            writeSample(p, bytes, isFloat, readSample(p, bytes, isFloat) * gain);
+        }
+    }
+}
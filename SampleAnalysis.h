@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Load-time loudness analysis of a sample: an RMS envelope over short
+// windows and the point after which the sample stays below a threshold.
+struct TailAnalysis
+{
+    uint32_t windowFrames = 0;
+    std::vector<float> envelopeDb; // RMS of the loudest channel per window, dBFS
+    uint32_t audibleFrames = 0;    // end of the last window at or above the threshold
+};
+
+// interleaved PCM in; 16, 24 and 32-bit integer or 32-bit float
+TailAnalysis analyzeTail(const uint8_t* data, uint32_t frames, int channels, int bitsPerSample,
+    bool isFloat, uint32_t windowFrames, float thresholdDb);
+
+// linear fade to silence over the last fadeFrames frames, in place
+void fadeOutTail(uint8_t* data, uint32_t frames, uint32_t fadeFrames, int channels, int bitsPerSample, bool isFloat);
@@ -0,0 +1,250 @@
+#include "SampleBank.h"
+#include "RealtimeGuard.h"
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+constexpr char SampleBank::MAGIC[8];
+constexpr uint16_t SampleBank::FLAG_COMPRESSED;
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+SampleBank::~SampleBank()
+{
+    close();
+}
+
+bool SampleBank::write(const std::string& path, std::vector<Entry> entries,
+    const std::vector<const uint8_t*>& blobs)
+{
+    if (entries.size() != blobs.size()) return false;
+
+    Header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.entryCount = (uint32_t)entries.size();
+    header.alignment = ALIGNMENT;
+    header.indexOffset = sizeof(Header);
+    header.dataOffset = alignUp(header.indexOffset + entries.size() * sizeof(Entry), ALIGNMENT);
+
+    uint64_t offset = header.dataOffset;
+    for (auto& e : entries)
+    {
+        e.offset = offset;
+        offset = alignUp(offset + e.size, ALIGNMENT);
+    }
+
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f) return false;
+
+    f.write((const char*)&header, sizeof(header));
+    f.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+
+    static const char zeros[ALIGNMENT] = {};
+    uint64_t pos = header.indexOffset + entries.size() * sizeof(Entry);
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        f.write(zeros, (std::streamsize)(entries[i].offset - pos));
+        f.write((const char*)blobs[i], (std::streamsize)entries[i].size);
+        pos = entries[i].offset + entries[i].size;
+    }
+
+    // pad the tail so the last blob can be over-read up to the alignment
+    f.write(zeros, (std::streamsize)(alignUp(pos, ALIGNMENT) - pos));
+
+    return (bool)f;
+}
+
+bool SampleBank::open(const std::string& path, bool map)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(Header)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    fileSize = (uint64_t)size.QuadPart;
+
+    if (map) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view) {
+            if (mapping) CloseHandle(mapping);
+            close();
+            return false;
+        }
+
+        mappingHandle = mapping;
+        base = (const uint8_t*)view;
+    }
+#else
+    int handle = ::open(path.c_str(), O_RDONLY);
+    if (handle < 0) return false;
+
+    struct stat st;
+    if (fstat(handle, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+        ::close(handle);
+        return false;
+    }
+
+    fd = handle;
+    fileSize = (uint64_t)st.st_size;
+
+    if (map) {
+        void* view = mmap(nullptr, (size_t)fileSize, PROT_READ, MAP_SHARED, handle, 0);
+        if (view == MAP_FAILED) {
+            close();
+            return false;
+        }
+
+        base = (const uint8_t*)view;
+    }
+#endif
+
+    Header header;
+    if (!readAt(0, &header, sizeof(header))) {
+        close();
+        return false;
+    }
+
+    uint64_t indexEnd = header.indexOffset + (uint64_t)header.entryCount * sizeof(Entry);
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version < 1 || header.version > VERSION ||
+        header.indexOffset < sizeof(Header) || indexEnd > fileSize) {
+        close();
+        return false;
+    }
+
+    index.resize(header.entryCount);
+    if (!readAt(header.indexOffset, index.data(), header.entryCount * sizeof(Entry))) {
+        close();
+        return false;
+    }
+
+    for (const auto& e : index)
+    {
+        if (e.offset < indexEnd || e.offset > fileSize || e.size > fileSize - e.offset) {
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void SampleBank::close()
+{
+#ifdef _WIN32
+    if (base) UnmapViewOfFile(base);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+#else
+    if (base) munmap((void*)base, (size_t)fileSize);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+
+    base = nullptr;
+    fileSize = 0;
+    index.clear();
+}
+
+bool SampleBank::readAt(uint64_t offset, void* out, size_t bytes) const
+{
+    if (offset > fileSize || bytes > fileSize - offset) return false;
+
+    if (base) {
+        memcpy(out, base + offset, bytes);
+        return true;
+    }
+
+    RealtimeGuard::blocking("bank file read");
+    uint8_t* dst = (uint8_t*)out;
+    while (bytes > 0)
+    {
+#ifdef _WIN32
+        // an explicit offset per call, so concurrent reads do not share a file position
+        OVERLAPPED at{};
+        at.Offset = (DWORD)offset;
+        at.OffsetHigh = (DWORD)(offset >> 32);
+
+        DWORD chunk = bytes > 0x40000000 ? 0x40000000 : (DWORD)bytes;
+        DWORD got = 0;
+        if (!ReadFile((HANDLE)fileHandle, dst, chunk, &got, &at) || got == 0) return false;
+#else
+        ssize_t got = pread(fd, dst, bytes, (off_t)offset);
+        if (got <= 0) return false;
+#endif
+        dst += got;
+        offset += got;
+        bytes -= got;
+    }
+
+    return true;
+}
+
+bool SampleBank::read(const Entry& entry, uint64_t from, void* out, size_t bytes) const
+{
+    if (from > entry.size || bytes > entry.size - from) return false;
+    return readAt(entry.offset + from, out, bytes);
+}
+
+const SampleBank::Entry* SampleBank::find(int stringIndex, int fretIndex, int layer) const
+{
+    for (const auto& e : index)
+    {
+        if (e.stringIndex == stringIndex && e.fretIndex == fretIndex && e.layer == layer)
+            return &e;
+    }
+    return nullptr;
+}
+
+void SampleBank::touch(const Entry& entry, uint64_t bytes) const
+{
+    const volatile uint8_t* p = base + entry.offset;
+    uint64_t end = bytes < entry.size ? bytes : entry.size;
+    uint8_t sink = 0;
+    for (uint64_t i = 0; i < end; i += ALIGNMENT)
+        sink ^= p[i];
+    (void)sink;
+}
+
+void SampleBank::release(const Entry& entry, uint64_t from) const
+{
+    // only whole pages, the one holding `from` may still be in use
+    uint64_t first = alignUp(from, ALIGNMENT);
+    uint64_t end = alignUp(entry.size, ALIGNMENT);
+    if (first >= end) return;
+
+    void* start = (void*)(base + entry.offset + first);
+    size_t length = (size_t)(end - first);
+
+#ifdef _WIN32
+    // unlocking pages that were never locked drops them from the working set
+    VirtualUnlock(start, length);
+#else
+    madvise(start, length, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Single-file sample bank: a fixed header, an index of entries and the raw
+// sample data of every entry, each blob starting on an ALIGNMENT boundary.
+// The file is memory mapped read-only so samples can be played straight
+// out of the mapping without copying them to the heap, or opened for
+// positional reads only when it is too large to map.
+class SampleBank
+{
+public:
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint32_t ALIGNMENT = 4096;
+
+    // entry data is a SampleCodec stream rather than raw PCM (version 2+)
+    static constexpr uint16_t FLAG_COMPRESSED = 0x0001;
+
+    struct Format {
+        uint16_t formatTag;
+        uint16_t channels;
+        uint16_t bitsPerSample;
+        uint16_t blockAlign;
+        uint32_t sampleRate;
+        uint32_t avgBytesPerSec;
+    };
+
+    struct Entry {
+        uint16_t stringIndex;
+        uint16_t fretIndex;
+        uint16_t layer;
+        uint16_t flags;
+        Format format;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    SampleBank() = default;
+    ~SampleBank();
+
+    SampleBank(const SampleBank&) = delete;
+    SampleBank& operator=(const SampleBank&) = delete;
+
+    // writes entries[i] with the bytes in blobs[i]; offsets are assigned here
+    static bool write(const std::string& path, std::vector<Entry> entries,
+        const std::vector<const uint8_t*>& blobs);
+
+    bool open(const std::string& path, bool map = true);
+    void close();
+
+    bool isOpen() const { return fileSize != 0; }
+    bool isMapped() const { return base != nullptr; }
+    const std::vector<Entry>& entries() const { return index; }
+    const Entry* find(int stringIndex, int fretIndex, int layer = 0) const;
+    const uint8_t* data(const Entry& entry) const { return base + entry.offset; }
+    uint64_t mappedBytes() const { return base ? fileSize : 0; }
+
+    // copies bytes [from, from + bytes) of an entry; safe from any thread
+    bool read(const Entry& entry, uint64_t from, void* out, size_t bytes) const;
+
+    // mapped banks only: faults the pages of an entry in / lets the OS drop
+    // them again; touch stops after the first `bytes`, release keeps the
+    // pages before `from`
+    void touch(const Entry& entry, uint64_t bytes = UINT64_MAX) const;
+    void release(const Entry& entry, uint64_t from = 0) const;
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t alignment;
+        uint32_t reserved;
+        uint64_t indexOffset;
+        uint64_t dataOffset;
+    };
+
+    static constexpr char MAGIC[8] = { 'G', 'T', 'R', 'B', 'A', 'N', 'K', '\0' };
+
+    bool readAt(uint64_t offset, void* out, size_t bytes) const;
+
+    const uint8_t* base = nullptr;
+    uint64_t fileSize = 0;
+    std::vector<Entry> index;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
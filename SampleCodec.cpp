@@ -0,0 +1,356 @@
+#include "SampleCodec.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SAMPLECODEC_SSE2
+#include <emmintrin.h>
+#endif
+
+constexpr uint32_t SampleCodec::BLOCK_FRAMES;
+constexpr uint32_t SampleCodec::GROUP;
+
+static const char MAGIC[4] = { 'G', 'L', 'P', 'C' };
+static const int MAX_ORDER = 2;
+
+// history a block's predictor continues from, carried over between blocks
+struct PredictorState {
+    int32_t prev = 0;      // x[-1]
+    int32_t prevDelta = 0; // x[-1] - x[-2]
+};
+
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static int bitWidth(uint32_t v)
+{
+    int w = 0;
+    while (v) { w++; v >>= 1; }
+    return w;
+}
+
+static void residuals(const int32_t* x, uint32_t n, int order, const PredictorState& state, uint32_t* out)
+{
+    int32_t x1 = state.prev;
+    int32_t x2 = state.prev - state.prevDelta;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        int32_t r = x[i];
+        if (order == 1) r = x[i] - x1;
+        else if (order == 2) r = x[i] - 2 * x1 + x2;
+
+        out[i] = zigzag(r);
+        x2 = x1;
+        x1 = x[i];
+    }
+}
+
+static size_t packedSize(const uint32_t* v, uint32_t n)
+{
+    size_t bytes = 0;
+    for (uint32_t g = 0; g < n; g += SampleCodec::GROUP)
+    {
+        uint32_t all = 0;
+        for (uint32_t i = g; i < g + SampleCodec::GROUP && i < n; i++) all |= v[i];
+        bytes += 1 + 16 * bitWidth(all);
+    }
+    return bytes;
+}
+
+// value i of a group lives in lane i % 4, at bit (i / 4) * width of that
+// lane's stream of 32-bit words; word k of lane l is stored at k * 4 + l
+static void packGroup(const uint32_t* v, uint32_t n, std::vector<uint8_t>& out)
+{
+    uint32_t all = 0;
+    for (uint32_t i = 0; i < n; i++) all |= v[i];
+
+    int w = bitWidth(all);
+    out.push_back((uint8_t)w);
+    if (w == 0) return;
+
+    uint32_t words[4 * 32] = {};
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t lane = i & 3;
+        uint32_t bit = (i >> 2) * w;
+        uint32_t k = bit >> 5;
+        uint32_t off = bit & 31;
+
+        words[k * 4 + lane] |= v[i] << off;
+        if (off + w > 32)
+            words[(k + 1) * 4 + lane] |= v[i] >> (32 - off);
+    }
+
+    const uint8_t* bytes = (const uint8_t*)words;
+    out.insert(out.end(), bytes, bytes + 16 * w);
+}
+
+std::vector<uint8_t> SampleCodec::encode(const int16_t* samples, uint32_t frames, uint16_t channels)
+{
+    std::vector<uint8_t> out;
+    if (channels < 1 || channels > 2) return out;
+
+    StreamHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.frames = frames;
+    header.channels = channels;
+    header.blockFrames = (uint16_t)BLOCK_FRAMES;
+    out.insert(out.end(), (const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+
+    PredictorState state[2];
+    std::vector<int32_t> x(BLOCK_FRAMES);
+    std::vector<uint32_t> r[MAX_ORDER + 1];
+    for (auto& v : r) v.resize(BLOCK_FRAMES);
+
+    for (uint32_t start = 0; start < frames; start += BLOCK_FRAMES)
+    {
+        uint32_t n = frames - start < BLOCK_FRAMES ? frames - start : BLOCK_FRAMES;
+
+        for (uint16_t c = 0; c < channels; c++)
+        {
+            for (uint32_t i = 0; i < n; i++)
+                x[i] = samples[(size_t)(start + i) * channels + c];
+
+            int best = 0;
+            size_t bestSize = (size_t)-1;
+            for (int order = 0; order <= MAX_ORDER; order++)
+            {
+                residuals(x.data(), n, order, state[c], r[order].data());
+                size_t size = packedSize(r[order].data(), n);
+                if (size < bestSize) { best = order; bestSize = size; }
+            }
+
+            out.push_back((uint8_t)best);
+            for (uint32_t g = 0; g < n; g += GROUP)
+                packGroup(r[best].data() + g, n - g < GROUP ? n - g : GROUP, out);
+
+            state[c].prevDelta = n >= 2 ? x[n - 1] - x[n - 2] : x[n - 1] - state[c].prev;
+            state[c].prev = x[n - 1];
+        }
+    }
+
+    return out;
+}
+
+uint32_t SampleCodec::frameCount(const uint8_t* data, size_t size, uint16_t& channels)
+{
+    StreamHeader header;
+    if (size < sizeof(header)) return 0;
+
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.blockFrames != BLOCK_FRAMES ||
+        header.channels < 1 || header.channels > 2)
+        return 0;
+
+    channels = header.channels;
+    return header.frames;
+}
+
+static void unpackGroupScalar(const uint8_t* p, int w, uint32_t* out)
+{
+    if (w == 0) {
+        memset(out, 0, SampleCodec::GROUP * sizeof(uint32_t));
+        return;
+    }
+
+    uint32_t words[4 * 32];
+    memcpy(words, p, 16 * w);
+    uint32_t mask = w == 32 ? 0xFFFFFFFFu : (1u << w) - 1;
+
+    for (uint32_t i = 0; i < SampleCodec::GROUP; i++)
+    {
+        uint32_t lane = i & 3;
+        uint32_t bit = (i >> 2) * w;
+        uint32_t k = bit >> 5;
+        uint32_t off = bit & 31;
+
+        uint32_t v = words[k * 4 + lane] >> off;
+        if (off + w > 32)
+            v |= words[(k + 1) * 4 + lane] << (32 - off);
+        out[i] = v & mask;
+    }
+}
+
+static void undoPredictionScalar(const uint32_t* r, uint32_t n, int order, PredictorState& state, int32_t* x)
+{
+    int32_t x1 = state.prev;
+    int32_t d1 = state.prevDelta;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        int32_t v = unzigzag(r[i]);
+        if (order == 1) v += x1;
+        else if (order == 2) { d1 += v; v = x1 + d1; }
+
+        d1 = v - x1;
+        x1 = v;
+        x[i] = v;
+    }
+
+    state.prev = x1;
+    state.prevDelta = d1;
+}
+
+#ifdef SAMPLECODEC_SSE2
+static void unpackGroupSSE2(const uint8_t* p, int w, uint32_t* out)
+{
+    if (w == 0) {
+        memset(out, 0, SampleCodec::GROUP * sizeof(uint32_t));
+        return;
+    }
+
+    const __m128i mask = _mm_set1_epi32((int)((1u << w) - 1));
+    __m128i cur = _mm_loadu_si128((const __m128i*)p);
+    int k = 0;
+    int off = 0;
+
+    for (int j = 0; j < (int)SampleCodec::GROUP / 4; j++)
+    {
+        __m128i v = _mm_srl_epi32(cur, _mm_cvtsi32_si128(off));
+        off += w;
+
+        if (off >= 32) {
+            off -= 32;
+            if (++k < w) {
+                cur = _mm_loadu_si128((const __m128i*)(p + 16 * k));
+                if (off > 0)
+                    v = _mm_or_si128(v, _mm_sll_epi32(cur, _mm_cvtsi32_si128(w - off)));
+            }
+        }
+
+        _mm_storeu_si128((__m128i*)(out + 4 * j), _mm_and_si128(v, mask));
+    }
+}
+
+// inclusive prefix sum of four lanes plus the running carry in every lane
+static inline __m128i prefixSum(__m128i v, __m128i& carry)
+{
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi32(v, carry);
+    carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+    return v;
+}
+
+// n is padded up to a multiple of four; the padding residuals are zero
+static void undoPredictionSSE2(const uint32_t* r, uint32_t n, int order, PredictorState& state, int32_t* x)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t padded = (n + 3) & ~3u;
+
+    for (uint32_t i = 0; i < padded; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(r + i));
+        v = _mm_xor_si128(_mm_srli_epi32(v, 1), _mm_sub_epi32(zero, _mm_and_si128(v, one)));
+        _mm_storeu_si128((__m128i*)(x + i), v);
+    }
+
+    int32_t before = state.prev;
+
+    // each prediction order is undone by one more running sum
+    if (order >= 2) {
+        __m128i carry = _mm_set1_epi32(state.prevDelta);
+        for (uint32_t i = 0; i < padded; i += 4)
+            _mm_storeu_si128((__m128i*)(x + i), prefixSum(_mm_loadu_si128((const __m128i*)(x + i)), carry));
+    }
+    if (order >= 1) {
+        __m128i carry = _mm_set1_epi32(state.prev);
+        for (uint32_t i = 0; i < padded; i += 4)
+            _mm_storeu_si128((__m128i*)(x + i), prefixSum(_mm_loadu_si128((const __m128i*)(x + i)), carry));
+    }
+
+    state.prev = x[n - 1];
+    state.prevDelta = x[n - 1] - (n >= 2 ? x[n - 2] : before);
+}
+
+static void interleaveSSE2(const int32_t* left, const int32_t* right, uint32_t n, int16_t* out)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i l = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(left + i)),
+            _mm_loadu_si128((const __m128i*)(left + i + 4)));
+        __m128i r = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(right + i)),
+            _mm_loadu_si128((const __m128i*)(right + i + 4)));
+
+        _mm_storeu_si128((__m128i*)(out + 2 * i), _mm_unpacklo_epi16(l, r));
+        _mm_storeu_si128((__m128i*)(out + 2 * i + 8), _mm_unpackhi_epi16(l, r));
+    }
+    for (; i < n; i++)
+    {
+        out[2 * i] = (int16_t)left[i];
+        out[2 * i + 1] = (int16_t)right[i];
+    }
+}
+#endif
+
+bool SampleCodec::decode(const uint8_t* data, size_t size, int16_t* out, bool simd)
+{
+    uint16_t channels = 0;
+    uint32_t frames = frameCount(data, size, channels);
+    if (frames == 0) return false;
+
+#ifndef SAMPLECODEC_SSE2
+    simd = false;
+#endif
+
+    const uint8_t* p = data + sizeof(StreamHeader);
+    const uint8_t* end = data + size;
+
+    PredictorState state[2];
+    static thread_local uint32_t r[BLOCK_FRAMES];
+    static thread_local int32_t x[2][BLOCK_FRAMES];
+
+    for (uint32_t start = 0; start < frames; start += BLOCK_FRAMES)
+    {
+        uint32_t n = frames - start < BLOCK_FRAMES ? frames - start : BLOCK_FRAMES;
+
+        for (uint16_t c = 0; c < channels; c++)
+        {
+            if (p >= end) return false;
+            int order = *p++;
+            if (order > MAX_ORDER) return false;
+
+            for (uint32_t g = 0; g < n; g += GROUP)
+            {
+                if (p >= end) return false;
+                int w = *p++;
+                if (w > 32 || (size_t)(end - p) < (size_t)16 * w) return false;
+
+#ifdef SAMPLECODEC_SSE2
+                if (simd && w < 32) unpackGroupSSE2(p, w, r + g);
+                else
+#endif
+                unpackGroupScalar(p, w, r + g);
+                p += 16 * w;
+            }
+
+#ifdef SAMPLECODEC_SSE2
+            if (simd) undoPredictionSSE2(r, n, order, state[c], x[c]);
+            else
+#endif
+            undoPredictionScalar(r, n, order, state[c], x[c]);
+        }
+
+        int16_t* dst = out + (size_t)start * channels;
+#ifdef SAMPLECODEC_SSE2
+        if (simd && channels == 2) {
+            interleaveSSE2(x[0], x[1], n, dst);
+            continue;
+        }
+#endif
+        for (uint32_t i = 0; i < n; i++)
+            for (uint16_t c = 0; c < channels; c++)
+                dst[(size_t)i * channels + c] = (int16_t)x[c][i];
+    }
+
+    return true;
+}
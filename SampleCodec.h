@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Lossless codec for 16-bit PCM used by compressed sample bank entries.
+//
+// Each channel is split into blocks of BLOCK_FRAMES. Every block picks the
+// fixed polynomial predictor (order 0, 1 or 2) with the cheapest residual.
+// The zigzagged residuals are bit-packed in groups of GROUP values, each
+// group with its own bit width. The packed layout is four 32-bit lanes wide,
+// so unpacking, zigzag decoding and the prefix sums that undo the
+// prediction all run four samples at a time in SSE2.
+class SampleCodec
+{
+public:
+    static constexpr uint32_t BLOCK_FRAMES = 4096;
+    static constexpr uint32_t GROUP = 128;
+
+    // channels must be 1 or 2, samples are interleaved
+    static std::vector<uint8_t> encode(const int16_t* samples, uint32_t frames, uint16_t channels);
+
+    // frame count stored in a compressed stream, 0 if it is not one
+    static uint32_t frameCount(const uint8_t* data, size_t size, uint16_t& channels);
+
+    // out must hold frameCount() * channels samples
+    static bool decode(const uint8_t* data, size_t size, int16_t* out, bool simd = true);
+
+private:
+    struct StreamHeader {
+        char magic[4];
+        uint32_t frames;
+        uint16_t channels;
+        uint16_t blockFrames;
+    };
+};
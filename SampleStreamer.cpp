@@ -0,0 +1,191 @@
+#include "SampleStreamer.h"
+#include "RealtimeGuard.h"
+#include <algorithm>
+#include <cstring>
+
+constexpr uint32_t SampleStreamer::CHUNK_BYTES;
+constexpr uint32_t SampleStreamer::RING_CHUNKS;
+
+class SampleStreamer::Stream
+{
+public:
+    const SampleBank::Entry* entry = nullptr;
+    uint64_t from = 0;
+    uint32_t chunkBytes = 0;
+    uint32_t chunkCount = 0;
+
+    // chunk n lives in slot n % RING_CHUNKS; the counters only ever grow
+    // while the stream is open
+    std::vector<uint8_t> ring;
+    uint32_t sizes[RING_CHUNKS] = {};
+    std::atomic<uint32_t> filled{ 0 };
+    std::atomic<uint32_t> released{ 0 };
+    uint32_t taken = 0; // consumer only
+};
+
+SampleStreamer::SampleStreamer() = default;
+
+SampleStreamer::~SampleStreamer()
+{
+    stop();
+}
+
+void SampleStreamer::start(const SampleBank& source, int maxStreams)
+{
+    stop();
+
+    pool.reset(new Stream[maxStreams]);
+    idle.clear();
+    streams.clear();
+    idle.reserve(maxStreams);
+    streams.reserve(maxStreams);
+
+    for (int i = maxStreams - 1; i >= 0; i--)
+    {
+        pool[i].ring.resize((size_t)CHUNK_BYTES * RING_CHUNKS);
+        idle.push_back(&pool[i]);
+    }
+
+    bank = &source;
+    stopping = false;
+    ioThread = std::thread(&SampleStreamer::ioLoop, this);
+}
+
+void SampleStreamer::stop()
+{
+    if (!ioThread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.signal();
+    ioThread.join();
+
+    streams.clear();
+    idle.clear();
+    pool.reset();
+    bank = nullptr;
+}
+
+SampleStreamer::Stream* SampleStreamer::open(const SampleBank::Entry& entry, uint64_t from)
+{
+    uint32_t blockAlign = std::max<uint32_t>(1, entry.format.blockAlign);
+    if (blockAlign > CHUNK_BYTES) return nullptr;
+
+    Stream* s;
+    {
+        RealtimeGuard::blocking("streamer lock");
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle.empty()) return nullptr;
+
+        s = idle.back();
+        idle.pop_back();
+
+        s->entry = &entry;
+        s->from = std::min(from, entry.size);
+        s->chunkBytes = CHUNK_BYTES / blockAlign * blockAlign;
+        s->chunkCount = (uint32_t)((entry.size - s->from + s->chunkBytes - 1) / s->chunkBytes);
+        s->filled.store(0, std::memory_order_relaxed);
+        s->released.store(0, std::memory_order_relaxed);
+        s->taken = 0;
+
+        streams.push_back(s);
+    }
+    wake.signal();
+
+    return s;
+}
+
+void SampleStreamer::close(Stream* stream)
+{
+    if (!stream) return;
+
+    RealtimeGuard::blocking("streamer lock");
+    std::unique_lock<std::mutex> lock(mutex);
+    streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
+
+    // the I/O thread may still be reading into its ring
+    readDone.wait(lock, [&]() { return reading != stream; });
+    idle.push_back(stream);
+}
+
+bool SampleStreamer::next(Stream* stream, Chunk& out)
+{
+    if (stream->taken >= stream->filled.load(std::memory_order_acquire))
+        return false;
+
+    uint32_t slot = stream->taken % RING_CHUNKS;
+    out.data = &stream->ring[(size_t)slot * stream->chunkBytes];
+    out.bytes = stream->sizes[slot];
+    out.last = stream->taken + 1 == stream->chunkCount;
+
+    stream->taken++;
+    return true;
+}
+
+void SampleStreamer::release(Stream* stream)
+{
+    // called from the audio thread, so no lock; the signal is kept even if
+    // the I/O thread is only about to wait
+    stream->released.fetch_add(1, std::memory_order_release);
+    wake.signal();
+}
+
+bool SampleStreamer::finished(const Stream* stream) const
+{
+    return stream->taken == stream->chunkCount;
+}
+
+void SampleStreamer::ioLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!stopping)
+    {
+        // top up the stream with the least data buffered first
+        Stream* pick = nullptr;
+        uint32_t pickBuffered = RING_CHUNKS;
+
+        for (Stream* s : streams)
+        {
+            uint32_t filled = s->filled.load(std::memory_order_relaxed);
+            uint32_t buffered = filled - s->released.load(std::memory_order_acquire);
+
+            if (filled < s->chunkCount && buffered < pickBuffered) {
+                pick = s;
+                pickBuffered = buffered;
+            }
+        }
+
+        // until a stream opens, a chunk is released or it is time to stop
+        if (!pick) {
+            lock.unlock();
+            wake.wait();
+            lock.lock();
+            continue;
+        }
+
+        reading = pick;
+        lock.unlock();
+
+        uint32_t n = pick->filled.load(std::memory_order_relaxed);
+        uint32_t slot = n % RING_CHUNKS;
+        uint64_t offset = pick->from + (uint64_t)n * pick->chunkBytes;
+        uint32_t bytes = (uint32_t)std::min<uint64_t>(pick->chunkBytes, pick->entry->size - offset);
+        uint8_t* dst = &pick->ring[(size_t)slot * pick->chunkBytes];
+
+        // a failed read still produces a chunk, of silence, so the voice ends
+        if (!bank->read(*pick->entry, offset, dst, bytes)) {
+            memset(dst, 0, bytes);
+            errors++;
+        }
+        totalRead += bytes;
+
+        lock.lock();
+        pick->sizes[slot] = bytes;
+        pick->filled.store(n + 1, std::memory_order_release);
+        reading = nullptr;
+        readDone.notify_all();
+    }
+}
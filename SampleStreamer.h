@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "SampleBank.h"
+#include "WakeSignal.h"
+
+// Streams bank entries from disk on a dedicated I/O thread. Every stream
+// owns a ring of RING_CHUNKS fixed-size chunks that the I/O thread keeps
+// filled ahead of the consumer. A chunk handed out by next() is only
+// refilled once it is given back with release(), so it can stay queued on
+// a voice in between. Streams and their rings are all allocated by start(),
+// so opening and closing one never touches the heap.
+class SampleStreamer
+{
+public:
+    static constexpr uint32_t CHUNK_BYTES = 64 * 1024;
+    static constexpr uint32_t RING_CHUNKS = 4;
+
+    struct Chunk {
+        const uint8_t* data;
+        uint32_t bytes;
+        bool last;
+    };
+
+    class Stream;
+
+    SampleStreamer();
+    ~SampleStreamer();
+
+    SampleStreamer(const SampleStreamer&) = delete;
+    SampleStreamer& operator=(const SampleStreamer&) = delete;
+
+    // reads through `bank`, which has to stay open until stop(); at most
+    // `maxStreams` streams can be open at once
+    void start(const SampleBank& bank, int maxStreams);
+    void stop();
+
+    // streams bytes [from, entry.size) of an entry; chunks hold whole
+    // frames. nullptr when all streams are taken
+    Stream* open(const SampleBank::Entry& entry, uint64_t from);
+    void close(Stream* stream);
+
+    // consumer side, one thread per stream: the next filled chunk in order,
+    // false when none is ready (yet)
+    bool next(Stream* stream, Chunk& out);
+    void release(Stream* stream);
+    bool finished(const Stream* stream) const;
+
+    uint64_t bytesRead() const { return totalRead; }
+    unsigned long long readErrors() const { return errors; }
+
+private:
+    void ioLoop();
+
+    const SampleBank* bank = nullptr;
+    std::unique_ptr<Stream[]> pool;
+    std::vector<Stream*> idle;
+    std::vector<Stream*> streams;
+    Stream* reading = nullptr;
+
+    std::mutex mutex;
+    WakeSignal wake;
+    std::condition_variable readDone;
+    std::thread ioThread;
+    bool stopping = false;
+
+    std::atomic<uint64_t> totalRead{ 0 };
+    std::atomic<unsigned long long> errors{ 0 };
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Bounded single-producer/single-consumer ring. push() and pop() never
+// block or allocate: each index is only written by its own side, and the
+// two sides meet through an acquire/release pair on it.
+template <typename T, int CAPACITY>
+class SpscQueue
+{
+public:
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+    static constexpr int capacity() { return CAPACITY; }
+
+    // producer side, false when the queue is full
+    bool push(const T& item)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == (uint32_t)CAPACITY) return false;
+
+        items[t & (CAPACITY - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, false when the queue is empty
+    bool pop(T& item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) == h) return false;
+
+        item = items[h & (CAPACITY - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // a snapshot, the other side may have moved on by the time it returns
+    int size() const
+    {
+        return (int)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+    }
+
+private:
+    // on separate cache lines so the two sides do not keep stealing them
+    alignas(64) std::atomic<uint32_t> head{ 0 };
+    alignas(64) std::atomic<uint32_t> tail{ 0 };
+    alignas(64) T items[CAPACITY];
+};
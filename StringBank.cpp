@@ -0,0 +1,366 @@
+#include "StringBank.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRINGBANK_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define STRINGBANK_NEON
+#include <arm_neon.h>
+#endif
+
+constexpr int StringBank::STRINGS;
+constexpr int StringBank::LANES;
+constexpr int StringBank::RING;
+constexpr uint64_t StringBank::NEVER;
+
+static const float SILENCE = 1e-5f; // -100 dBFS
+
+// four lanes of floats, with only what the loop needs
+#if defined(STRINGBANK_SSE2)
+typedef __m128 Lanes;
+static inline Lanes load(const float* p) { return _mm_load_ps(p); }
+static inline void store(float* p, Lanes v) { _mm_store_ps(p, v); }
+static inline Lanes splat(float x) { return _mm_set1_ps(x); }
+static inline Lanes lanes(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+static inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes loadAnywhere(const float* p) { return _mm_loadu_ps(p); }
+static inline Lanes maxAbs(Lanes m, Lanes v) { return _mm_max_ps(m, _mm_andnot_ps(_mm_set1_ps(-0.0f), v)); }
+static inline float maxAcross(Lanes v)
+{
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+}
+#elif defined(STRINGBANK_NEON)
+typedef float32x4_t Lanes;
+static inline Lanes load(const float* p) { return vld1q_f32(p); }
+static inline void store(float* p, Lanes v) { vst1q_f32(p, v); }
+static inline Lanes splat(float x) { return vdupq_n_f32(x); }
+static inline Lanes lanes(float a, float b, float c, float d)
+{
+    const float v[4] = { a, b, c, d };
+    return vld1q_f32(v);
+}
+static inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+static inline Lanes loadAnywhere(const float* p) { return vld1q_f32(p); }
+static inline Lanes maxAbs(Lanes m, Lanes v) { return vmaxq_f32(m, vabsq_f32(v)); }
+static inline float maxAcross(Lanes v)
+{
+    float32x2_t m = vmax_f32(vget_low_f32(v), vget_high_f32(v));
+    return std::max(vget_lane_f32(m, 0), vget_lane_f32(m, 1));
+}
+#else
+struct Lanes { float v[4]; };
+static inline Lanes load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+static inline void store(float* p, Lanes a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+static inline Lanes splat(float x) { return { { x, x, x, x } }; }
+static inline Lanes lanes(float a, float b, float c, float d) { return { { a, b, c, d } }; }
+static inline Lanes add(Lanes a, Lanes b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+static inline Lanes sub(Lanes a, Lanes b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+static inline Lanes mul(Lanes a, Lanes b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+static inline Lanes loadAnywhere(const float* p) { return load(p); }
+static inline Lanes maxAbs(Lanes m, Lanes a) { for (int i = 0; i < 4; i++) m.v[i] = std::max(m.v[i], std::fabs(a.v[i])); return m; }
+static inline float maxAcross(Lanes v) { return std::max(std::max(v.v[0], v.v[1]), std::max(v.v[2], v.v[3])); }
+#endif
+
+// largest magnitude among `count` floats
+static float peakOf(const float* p, uint32_t count)
+{
+    Lanes m = splat(0.0f);
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        m = maxAbs(m, loadAnywhere(p + i));
+
+    float peak = maxAcross(m);
+    for (; i < count; i++)
+        peak = std::max(peak, std::fabs(p[i]));
+    return peak;
+}
+
+StringBank::Coupling StringBank::bridgeCoupling(float amount)
+{
+    Coupling c = {};
+    for (int i = 0; i < STRINGS; i++)
+        for (int k = 0; k < STRINGS; k++)
+            c[i][k] = i == k ? 0.0f : amount;
+    return c;
+}
+
+void StringBank::reset(const std::array<StringModel, STRINGS>& strings, const Coupling& matrix)
+{
+    models = strings;
+    requested = matrix;
+    now = 0;
+    write = 0;
+
+    for (int s = 0; s < STRINGS; s++)
+    {
+        pending[s] = Pending();
+        gain[s] = 1.0f;
+        gainStep[s] = 0.0f;
+        retune(s, 0);
+    }
+
+    silence();
+}
+
+void StringBank::pluck(int string, int fret, float level, uint32_t seed, uint32_t delay)
+{
+    Pending& p = pending[string];
+    p.pluckAt = now + delay;
+    p.fret = fret;
+    p.level = level;
+    p.seed = seed;
+}
+
+void StringBank::damp(int string, uint32_t frames, uint32_t delay)
+{
+    Pending& p = pending[string];
+    p.pluckAt = NEVER;
+    p.dampAt = now + delay;
+    p.dampFrames = frames;
+}
+
+uint32_t StringBank::generate(float* out, uint32_t frames)
+{
+    for (int l = 0; l < LANES; l++)
+        peak[l] = 0.0f;
+
+    // runs between the frames something happens on
+    const uint64_t end = now + frames;
+    while (now < end)
+    {
+        uint64_t next = end;
+        for (int s = 0; s < STRINGS; s++)
+        {
+            apply(s);
+            next = std::min({ next, pending[s].pluckAt, pending[s].dampAt, pending[s].openAt });
+        }
+
+        uint32_t n = (uint32_t)(next - now);
+        float* dst = out + (frames - (uint32_t)(end - now));
+        if (idle)
+            memset(dst, 0, n * sizeof(float));
+        else
+            run(dst, n);
+        now = next;
+    }
+
+    float loudest = 0.0f;
+    for (int s = 0; s < STRINGS; s++)
+        loudest = std::max(loudest, peak[s]);
+
+    quietFrames = idle || loudest >= SILENCE ? 0 : quietFrames + frames;
+    if (quietFrames >= (uint32_t)RING) silence();
+    return frames;
+}
+
+float StringBank::levelDb(int string) const
+{
+    return 20.0f * std::log10(std::max(peak[string], 1e-6f));
+}
+
+// one vector of the loop: four strings' filters and state, kept in
+// registers for a whole run
+struct LoopLanes
+{
+    Lanes now, before, disperse, tune; // the loss gain folded into both taps
+    Lanes lossPrev, dispIn, dispOut, tuneIn, tuneOut;
+    Lanes heard, heardStep;
+};
+
+// KarplusStrong::generate for four strings at once, from the line output
+// plus whatever came in through the bridge; returns what goes back in
+static inline Lanes feedBack(LoopLanes& q, Lanes x)
+{
+    Lanes lost = add(mul(q.now, x), mul(q.before, q.lossPrev));
+    q.lossPrev = x;
+
+    Lanes dispersed = add(mul(q.disperse, sub(lost, q.dispOut)), q.dispIn);
+    q.dispIn = lost;
+    q.dispOut = dispersed;
+
+    Lanes tuned = add(mul(q.tune, sub(dispersed, q.tuneOut)), q.tuneIn);
+    q.tuneIn = dispersed;
+    q.tuneOut = tuned;
+    return tuned;
+}
+
+void StringBank::run(float* out, uint32_t frames)
+{
+    LoopLanes q[2];
+    for (int h = 0; h < 2; h++)
+    {
+        const int l = 4 * h;
+        Lanes loss = load(lossGain + l), smooth = load(smoothing + l);
+        q[h].now = mul(loss, sub(splat(1.0f), smooth));
+        q[h].before = mul(loss, smooth);
+        q[h].disperse = load(dispersion + l);
+        q[h].tune = load(tuning + l);
+        q[h].lossPrev = load(lossState + l);
+        q[h].dispIn = load(dispersionIn + l);
+        q[h].dispOut = load(dispersionOut + l);
+        q[h].tuneIn = load(tuningIn + l);
+        q[h].tuneOut = load(tuningOut + l);
+        q[h].heard = load(gain + l);
+        q[h].heardStep = load(gainStep + l);
+    }
+
+    // named halves and a local write position, so the compiler keeps them
+    // in registers
+    LoopLanes low = q[0], high = q[1];
+    alignas(16) float tuned[LANES];
+    const uint32_t mask = RING - 1;
+    const uint32_t first = write;
+    uint32_t w = write;
+
+    // the per-string steps are spelled out six times, as a loop over the
+    // strings would not be unrolled at -O2
+    auto tap = [&](int s) { return lines[s][(w - length[s]) & mask]; };
+    auto put = [&](int s) { lines[s][w & mask] = tuned[s]; };
+
+    for (uint32_t i = 0; i < frames; i++, w++)
+    {
+        const float y[STRINGS] = { tap(0), tap(1), tap(2), tap(3), tap(4), tap(5) };
+        Lanes inLow = lanes(y[0], y[1], y[2], y[3]);
+        Lanes inHigh = lanes(y[4], y[5], 0.0f, 0.0f);
+        Lanes xLow = inLow, xHigh = inHigh;
+
+        // what reaches each string from the others through the bridge
+        if (coupled) {
+            auto couple = [&](int k) {
+                Lanes from = splat(y[k]);
+                xLow = add(xLow, mul(from, load(coupling[k])));
+                xHigh = add(xHigh, mul(from, load(coupling[k] + 4)));
+            };
+            couple(0); couple(1); couple(2); couple(3); couple(4); couple(5);
+        }
+
+        store(tuned, feedBack(low, xLow));
+        store(tuned + 4, feedBack(high, xHigh));
+        put(0); put(1); put(2); put(3); put(4); put(5);
+
+        store(partial + 4 * i, add(mul(inLow, low.heard), mul(inHigh, high.heard)));
+        low.heard = add(low.heard, low.heardStep);
+        high.heard = add(high.heard, high.heardStep);
+    }
+    write = w;
+
+    q[0] = low;
+    q[1] = high;
+    for (int h = 0; h < 2; h++)
+    {
+        const int l = 4 * h;
+        store(lossState + l, q[h].lossPrev);
+        store(dispersionIn + l, q[h].dispIn);
+        store(dispersionOut + l, q[h].dispOut);
+        store(tuningIn + l, q[h].tuneIn);
+        store(tuningOut + l, q[h].tuneOut);
+        store(gain + l, q[h].heard);
+    }
+
+    // each string's level, from what went back into its line: the frames
+    // just written, in at most two pieces around the end of the ring
+    uint32_t span = std::min(frames, (uint32_t)RING);
+    uint32_t start = (first + frames - span) & mask;
+    uint32_t piece = std::min(span, (uint32_t)RING - start);
+    for (int s = 0; s < STRINGS; s++)
+        peak[s] = std::max({ peak[s], peakOf(lines[s] + start, piece), peakOf(lines[s], span - piece) });
+
+    for (uint32_t i = 0; i < frames; i++)
+        out[i] = (partial[4 * i] + partial[4 * i + 1]) + (partial[4 * i + 2] + partial[4 * i + 3]);
+}
+
+void StringBank::apply(int string)
+{
+    Pending& p = pending[string];
+
+    // the ramp starts from wherever an earlier damp left the gain
+    if (p.dampAt <= now) {
+        p.dampAt = NEVER;
+        p.openAt = now + p.dampFrames;
+        gainStep[string] = p.dampFrames ? -gain[string] / p.dampFrames : 0.0f;
+    }
+
+    // damped all the way: the finger lifts and the string is open again,
+    // silent but free to resonate
+    if (p.openAt <= now) {
+        p.openAt = NEVER;
+        memset(lines[string], 0, sizeof(lines[string]));
+        lossState[string] = dispersionIn[string] = dispersionOut[string] = 0.0f;
+        tuningIn[string] = tuningOut[string] = 0.0f;
+        gain[string] = 1.0f;
+        gainStep[string] = 0.0f;
+        retune(string, 0);
+    }
+
+    if (p.pluckAt <= now) {
+        p.pluckAt = NEVER;
+        p.openAt = NEVER;
+        retune(string, p.fret);
+
+        // the line is read `length` behind the write position, so the pluck
+        // goes in just behind it
+        int n = length[string];
+        KarplusStrong::excite(excitation, n, models[string].pickPosition, p.level, p.seed);
+        for (int i = 0; i < n; i++)
+            lines[string][(write - n + i) & (RING - 1)] = excitation[i];
+
+        lossState[string] = dispersionIn[string] = dispersionOut[string] = 0.0f;
+        tuningIn[string] = tuningOut[string] = 0.0f;
+        gain[string] = 1.0f;
+        gainStep[string] = 0.0f;
+        quietFrames = 0;
+        idle = false;
+    }
+}
+
+void StringBank::retune(int string, int fret)
+{
+    KarplusStrong::Loop loop = KarplusStrong::design(models[string], fret);
+    length[string] = loop.length;
+    lossGain[string] = loop.lossGain;
+    smoothing[string] = loop.smoothing;
+    dispersion[string] = loop.dispersion;
+    tuning[string] = loop.tuning;
+    scaleCoupling();
+}
+
+void StringBank::scaleCoupling()
+{
+    // a row takes in at most half of what its loop loses per trip, which
+    // keeps the loop gain of every string below unity whatever it is tuned to
+    coupled = false;
+    for (int i = 0; i < STRINGS; i++)
+    {
+        float sum = 0.0f;
+        for (int k = 0; k < STRINGS; k++)
+            sum += std::fabs(requested[i][k]);
+
+        float g = std::max(lossGain[i], 1e-3f);
+        float room = 0.5f * (1.0f - g) / g;
+        float scale = sum > room ? room / sum : 1.0f;
+
+        for (int k = 0; k < STRINGS; k++)
+        {
+            coupling[k][i] = requested[i][k] * scale;
+            coupled = coupled || coupling[k][i] != 0.0f;
+        }
+    }
+}
+
+void StringBank::silence()
+{
+    memset(lines, 0, sizeof(lines));
+    for (int l = 0; l < LANES; l++)
+        lossState[l] = dispersionIn[l] = dispersionOut[l] = tuningIn[l] = tuningOut[l] = 0.0f;
+
+    quietFrames = 0;
+    idle = true;
+}
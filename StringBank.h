@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include "KarplusStrong.h"
+
+// All six strings of the guitar as one generator: the KarplusStrong loop,
+// run for every string in the same step with a string per SIMD lane, so the
+// bank costs under twice what a single string does. The strings are coupled
+// through the bridge: each one's loop takes in a little of the others'
+// motion, so open strings pick up the notes they share harmonics with and
+// ring along. One note per string, like the real thing; a new pluck cuts the
+// note before it, and a damped string falls silent over the release and
+// opens up again to resonate. Plucks and damps land on exact frames.
+// Nothing allocates after construction, so all of it can run on the audio
+// thread.
+class StringBank : public Mixer::Generator
+{
+public:
+    static constexpr int STRINGS = 6;
+
+    typedef std::array<std::array<float, STRINGS>, STRINGS> Coupling;
+
+    // how much of string k's motion row i takes in through the bridge, the
+    // same `amount` between every pair and nothing from itself
+    static Coupling bridgeCoupling(float amount);
+
+    // every string open and silent; `strings` is low E first
+    void reset(const std::array<StringModel, STRINGS>& strings, const Coupling& coupling);
+
+    // `delay` frames into the following generate() calls; a pluck still
+    // pending on the string is replaced
+    void pluck(int string, int fret, float level, uint32_t seed, uint32_t delay = 0);
+
+    // fades the string out over `frames` and cancels a pending pluck
+    void damp(int string, uint32_t frames, uint32_t delay = 0);
+
+    // mono; always fills all `frames`, as the bank never ends
+    uint32_t generate(float* out, uint32_t frames) override;
+
+    // peak of the string's motion over the last call, whether or not it is
+    // being played
+    float levelDb(int string) const;
+
+private:
+    // two vectors of four; the last two lanes stay silent
+    static constexpr int LANES = 8;
+    static constexpr int RING = KarplusStrong::MAX_PERIOD;
+    static constexpr uint64_t NEVER = ~0ull;
+
+    void run(float* out, uint32_t frames);
+    void apply(int string);
+    void retune(int string, int fret);
+    void scaleCoupling();
+    void silence();
+
+    // every string's delay line is read `length` behind the shared write
+    // position, so the ring never needs more than the longest period
+    alignas(16) float lines[STRINGS][RING];
+    uint32_t write = 0;
+    int length[STRINGS] = {};
+
+    // per lane: the KarplusStrong loop filters and their state, and the
+    // gain the lane is heard at, which ramps to 0 while it is damped
+    alignas(16) float lossGain[LANES] = {};
+    alignas(16) float smoothing[LANES] = {};
+    alignas(16) float dispersion[LANES] = {};
+    alignas(16) float tuning[LANES] = {};
+    alignas(16) float lossState[LANES] = {};
+    alignas(16) float dispersionIn[LANES] = {};
+    alignas(16) float dispersionOut[LANES] = {};
+    alignas(16) float tuningIn[LANES] = {};
+    alignas(16) float tuningOut[LANES] = {};
+    alignas(16) float gain[LANES] = {};
+    alignas(16) float gainStep[LANES] = {};
+    alignas(16) float peak[LANES] = {};
+
+    // coupling[k] is the column taken in from string k, one lane per row,
+    // scaled down where a row would feed its loop back above unity
+    alignas(16) float coupling[STRINGS][LANES] = {};
+    Coupling requested = {};
+    bool coupled = false;
+
+    // pending events, in frames of `now`
+    struct Pending {
+        uint64_t pluckAt = NEVER;
+        int fret = 0;
+        float level = 0.0f;
+        uint32_t seed = 0;
+        uint64_t dampAt = NEVER;
+        uint32_t dampFrames = 0;
+        uint64_t openAt = NEVER; // the end of a damp
+    };
+    Pending pending[STRINGS];
+    std::array<StringModel, STRINGS> models;
+    uint64_t now = 0;
+
+    // frames in a row every lane stayed below -100 dBFS; once that covers
+    // the longest period the lines are cleared and skipped until a pluck
+    uint32_t quietFrames = 0;
+    bool idle = true;
+
+    // four lanes summed per frame, added up across once the block is done
+    alignas(16) float partial[Mixer::MAX_BLOCK_FRAMES * 4];
+    float excitation[KarplusStrong::MAX_PERIOD];
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <array>
+
+// Fixed-capacity pool allocated once up front. acquire() and release() are
+// O(1) and never allocate; live entries stay on an intrusive list in the
+// order they were acquired, so iterating them is deterministic.
+template <typename T, int CAPACITY>
+class VoicePool
+{
+public:
+    static constexpr int capacity() { return CAPACITY; }
+
+    VoicePool()
+    {
+        for (int i = 0; i < CAPACITY; i++)
+        {
+            freeList[i] = CAPACITY - 1 - i;
+            live[i] = false;
+        }
+    }
+
+    // the index of a fresh entry, or -1 when the pool is full
+    int acquire()
+    {
+        if (freeCount == 0) return -1;
+
+        int i = freeList[--freeCount];
+        live[i] = true;
+        prev[i] = tail;
+        next[i] = -1;
+        if (tail >= 0) next[tail] = i; else head = i;
+        tail = i;
+        count++;
+        return i;
+    }
+
+    void release(int i)
+    {
+        if (i < 0 || i >= CAPACITY || !live[i]) return;
+
+        if (prev[i] >= 0) next[prev[i]] = next[i]; else head = next[i];
+        if (next[i] >= 0) prev[next[i]] = prev[i]; else tail = prev[i];
+        live[i] = false;
+        freeList[freeCount++] = i;
+        count--;
+    }
+
+    T& operator[](int i) { return items[i]; }
+    const T& operator[](int i) const { return items[i]; }
+    bool isLive(int i) const { return i >= 0 && i < CAPACITY && live[i]; }
+    int size() const { return count; }
+
+    // live entries oldest first; read after() before releasing an entry
+    int first() const { return head; }
+    int after(int i) const { return next[i]; }
+
+private:
+    std::array<T, CAPACITY> items;
+    int freeList[CAPACITY];
+    int freeCount = CAPACITY;
+    int prev[CAPACITY];
+    int next[CAPACITY];
+    bool live[CAPACITY];
+    int head = -1;
+    int tail = -1;
+    int count = 0;
+};
@@ -0,0 +1,51 @@
+#include "WakeSignal.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#endif
+
+WakeSignal::WakeSignal()
+{
+#ifdef _WIN32
+    semaphore = CreateSemaphoreW(nullptr, 0, 1, nullptr);
+#else
+    sem_init(&semaphore, 0, 0);
+#endif
+}
+
+WakeSignal::~WakeSignal()
+{
+#ifdef _WIN32
+    CloseHandle(semaphore);
+#else
+    sem_destroy(&semaphore);
+#endif
+}
+
+void WakeSignal::signal()
+{
+    // one post until the worker wakes, so the count never runs up
+    if (pending.exchange(true, std::memory_order_acq_rel)) return;
+
+#ifdef _WIN32
+    ReleaseSemaphore(semaphore, 1, nullptr);
+#else
+    sem_post(&semaphore);
+#endif
+}
+
+void WakeSignal::wait()
+{
+#ifdef _WIN32
+    WaitForSingleObject(semaphore, INFINITE);
+#else
+    while (sem_wait(&semaphore) != 0 && errno == EINTR) {}
+#endif
+
+    // cleared before the caller looks, so whatever is signalled from here on
+    // posts again; an exchange, so a signal() that found it still set is
+    // ordered before this and what it signalled is visible to the caller
+    pending.exchange(false, std::memory_order_acq_rel);
+}
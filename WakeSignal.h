@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+
+#ifdef _WIN32
+typedef void* HANDLE;
+#else
+#include <semaphore.h>
+#endif
+
+// Wakes a worker thread from any thread, the audio thread included: signal()
+// never takes a lock or blocks, and a signal sent while the worker is not
+// waiting yet is kept until it does, so none is ever lost. Signals sent
+// before the worker gets to run again count as one. Backed by an OS
+// semaphore, as a condition variable forgets a notify that arrives between
+// checking its predicate and going to sleep unless the sender holds the lock.
+class WakeSignal
+{
+public:
+    WakeSignal();
+    ~WakeSignal();
+
+    WakeSignal(const WakeSignal&) = delete;
+    WakeSignal& operator=(const WakeSignal&) = delete;
+
+    void signal();
+
+    // returns at once if signalled since the last wait() returned; check
+    // what the signal is about afterwards, not before
+    void wait();
+
+private:
+    std::atomic<bool> pending{ false };
+#ifdef _WIN32
+    HANDLE semaphore;
+#else
+    sem_t semaphore;
+#endif
+};
@@ -0,0 +1,122 @@
+#include "WavParser.h"
+#include <cstring>
+
+constexpr uint16_t WavInfo::FORMAT_PCM;
+constexpr uint16_t WavInfo::FORMAT_IEEE_FLOAT;
+constexpr uint16_t WavInfo::FORMAT_EXTENSIBLE;
+
+static uint16_t readU16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t readU32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static WavError parseFmt(const uint8_t* p, uint32_t size, WavInfo& out)
+{
+    if (size < 16) return WavError::BadFmtChunk;
+
+    out.formatTag = readU16(p);
+    out.channels = readU16(p + 2);
+    out.sampleRate = readU32(p + 4);
+    out.avgBytesPerSec = readU32(p + 8);
+    out.blockAlign = readU16(p + 12);
+    out.bitsPerSample = readU16(p + 14);
+    out.validBitsPerSample = out.bitsPerSample;
+
+    if (out.formatTag == WavInfo::FORMAT_EXTENSIBLE)
+    {
+        // cbSize, valid bits, channel mask, then the sub-format GUID whose
+        // first two bytes hold the actual format tag
+        if (size < 40 || readU16(p + 16) < 22) return WavError::BadFmtChunk;
+
+        out.validBitsPerSample = readU16(p + 18);
+        out.channelMask = readU32(p + 20);
+        out.formatTag = readU16(p + 24);
+    }
+
+    if (out.channels == 0 || out.sampleRate == 0) return WavError::BadFmtChunk;
+    if (out.bitsPerSample == 0 || out.bitsPerSample % 8 != 0) return WavError::BadFmtChunk;
+    if (out.blockAlign != out.channels * (out.bitsPerSample / 8)) return WavError::BadFmtChunk;
+    if (out.validBitsPerSample == 0 || out.validBitsPerSample > out.bitsPerSample) return WavError::BadFmtChunk;
+
+    bool pcm = out.formatTag == WavInfo::FORMAT_PCM && out.bitsPerSample <= 32;
+    bool ieee = out.formatTag == WavInfo::FORMAT_IEEE_FLOAT && out.bitsPerSample == 32;
+    if (!pcm && !ieee) return WavError::UnsupportedFormat;
+
+    return WavError::None;
+}
+
+WavError parseWav(const uint8_t* bytes, size_t size, WavInfo& out)
+{
+    out = WavInfo();
+
+    if (size < 12) return WavError::TooShort;
+    if (memcmp(bytes, "RIFF", 4) != 0) return WavError::NotRiff;
+    if (memcmp(bytes + 8, "WAVE", 4) != 0) return WavError::NotWave;
+
+    // trust the RIFF size only as far as the span actually goes
+    size_t end = (size_t)readU32(bytes + 4) + 8;
+    if (end > size || end < 12) end = size;
+
+    bool haveFmt = false;
+    size_t pos = 12;
+
+    while (end - pos >= 8)
+    {
+        const uint8_t* chunk = bytes + pos;
+        uint32_t chunkSize = readU32(chunk + 4);
+        size_t body = pos + 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0)
+        {
+            if (chunkSize > end - body) return WavError::TruncatedChunk;
+
+            WavError error = parseFmt(bytes + body, chunkSize, out);
+            if (error != WavError::None) return error;
+            haveFmt = true;
+        }
+        else if (memcmp(chunk, "data", 4) == 0)
+        {
+            if (!haveFmt) return WavError::MissingFmt;
+
+            // a data chunk cut short by the end of the file is still played,
+            // down to the last whole frame
+            size_t available = end - body;
+            size_t dataSize = chunkSize <= available ? chunkSize : available;
+            dataSize -= dataSize % out.blockAlign;
+            if (dataSize == 0) return WavError::TruncatedChunk;
+
+            out.data = bytes + body;
+            out.dataSize = dataSize;
+            return WavError::None;
+        }
+
+        // chunks are padded to an even size
+        uint64_t next = (uint64_t)body + chunkSize + (chunkSize & 1);
+        if (next > end) return WavError::TruncatedChunk;
+        pos = (size_t)next;
+    }
+
+    return haveFmt ? WavError::MissingData : WavError::MissingFmt;
+}
+
+const char* wavErrorString(WavError error)
+{
+    switch (error)
+    {
+    case WavError::None: return "no error";
+    case WavError::TooShort: return "file too short to be a WAV file";
+    case WavError::NotRiff: return "not a RIFF file";
+    case WavError::NotWave: return "RIFF file is not WAVE";
+    case WavError::TruncatedChunk: return "chunk runs past the end of the file";
+    case WavError::BadFmtChunk: return "malformed fmt chunk";
+    case WavError::MissingFmt: return "no fmt chunk before the data";
+    case WavError::MissingData: return "no data chunk";
+    case WavError::UnsupportedFormat: return "unsupported sample format";
+    }
+    return "unknown error";
+}
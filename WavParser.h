@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Bounded RIFF/WAVE parser working on a byte span that is already in memory.
+// Nothing is copied: the parsed data pointer points into the given span.
+
+enum class WavError
+{
+    None,
+    TooShort,
+    NotRiff,
+    NotWave,
+    TruncatedChunk,
+    BadFmtChunk,
+    MissingFmt,
+    MissingData,
+    UnsupportedFormat
+};
+
+struct WavInfo
+{
+    static constexpr uint16_t FORMAT_PCM = 0x0001;
+    static constexpr uint16_t FORMAT_IEEE_FLOAT = 0x0003;
+    static constexpr uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+
+    // WAVE_FORMAT_EXTENSIBLE is resolved to the tag of its sub-format
+    uint16_t formatTag = 0;
+    uint16_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint32_t avgBytesPerSec = 0;
+    uint16_t blockAlign = 0;
+    uint16_t bitsPerSample = 0;
+    uint16_t validBitsPerSample = 0;
+    uint32_t channelMask = 0;
+
+    const uint8_t* data = nullptr;
+    size_t dataSize = 0;
+};
+
+// accepts 8/16/24/32-bit integer PCM and 32-bit float, plain or extensible
+WavError parseWav(const uint8_t* bytes, size_t size, WavInfo& out);
+const char* wavErrorString(WavError error);
@@ -0,0 +1,102 @@
+#include "XAudio2Backend.h"
+#include "Mixer.h"
+
+#pragma comment(lib, "xaudio2.lib")
+
+XAudio2Backend::XAudio2Backend(int buffers)
+    : buffers(buffers < 2 ? 2 : (size_t)buffers)
+{
+}
+
+bool XAudio2Backend::open(Mixer& source)
+{
+    mixer = &source;
+
+    if (FAILED(XAudio2Create(&xaudio, 0))) {
+        close();
+        return false;
+    }
+
+    if (FAILED(xaudio->CreateMasteringVoice(&masterVoice))) {
+        close();
+        return false;
+    }
+
+    WAVEFORMATEX wfx{};
+    wfx.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+    wfx.nChannels = Mixer::CHANNELS;
+    wfx.nSamplesPerSec = Mixer::SAMPLE_RATE;
+    wfx.wBitsPerSample = 32;
+    wfx.nBlockAlign = wfx.nChannels * wfx.wBitsPerSample / 8;
+    wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
+
+    if (FAILED(xaudio->CreateSourceVoice(&sourceVoice, &wfx, 0, XAUDIO2_DEFAULT_FREQ_RATIO, this))) {
+        close();
+        return false;
+    }
+
+    for (auto& b : buffers)
+        b.assign(source.blockFrames() * Mixer::CHANNELS, 0.0f);
+
+    // keep every buffer queued; each one that finishes gets refilled
+    nextBuffer = 0;
+    running = false;
+    starved = 0;
+    framesSubmitted = 0;
+    for (size_t i = 0; i < buffers.size(); i++)
+        submitNext();
+
+    sourceVoice->Start();
+    running = true;
+    return true;
+}
+
+void XAudio2Backend::close()
+{
+    // destroying the voice waits for a callback that is still running
+    if (sourceVoice) sourceVoice->DestroyVoice();
+    if (masterVoice) masterVoice->DestroyVoice();
+    if (xaudio) xaudio->Release();
+
+    sourceVoice = nullptr;
+    masterVoice = nullptr;
+    xaudio = nullptr;
+    mixer = nullptr;
+}
+
+void XAudio2Backend::submitNext()
+{
+    // nothing left queued once playing means the voice went silent waiting
+    if (running) {
+        XAUDIO2_VOICE_STATE state;
+        sourceVoice->GetState(&state, XAUDIO2_VOICE_NOSAMPLESPLAYED);
+        if (state.BuffersQueued == 0) starved++;
+    }
+
+    std::vector<float>& block = buffers[nextBuffer];
+    nextBuffer = (nextBuffer + 1) % (int)buffers.size();
+
+    mixer->render(block.data());
+
+    XAUDIO2_BUFFER buf{};
+    buf.AudioBytes = (UINT32)(block.size() * sizeof(float));
+    buf.pAudioData = (const BYTE*)block.data();
+    sourceVoice->SubmitSourceBuffer(&buf);
+    framesSubmitted += block.size() / Mixer::CHANNELS;
+}
+
+uint64_t XAudio2Backend::queuedFrames() const
+{
+    if (!sourceVoice) return 0;
+
+    // what is still queued on the voice, plus what the engine holds between
+    // reading it and the speakers
+    XAUDIO2_VOICE_STATE state;
+    sourceVoice->GetState(&state);
+    uint64_t submitted = framesSubmitted.load();
+    uint64_t queued = submitted > state.SamplesPlayed ? submitted - state.SamplesPlayed : 0;
+
+    XAUDIO2_PERFORMANCE_DATA perf{};
+    xaudio->GetPerformanceData(&perf);
+    return queued + perf.CurrentLatencyInSamples;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <xaudio2.h>
+#include <vector>
+#include <atomic>
+#include "AudioBackend.h"
+
+// Plays the mixer output through a single float32 XAudio2 source voice,
+// rendering the next block from the voice callback whenever one finishes.
+// `buffers` blocks are kept queued, so the buffering latency is about that
+// many blocks plus the engine's own.
+class XAudio2Backend : public AudioBackend, private IXAudio2VoiceCallback
+{
+public:
+    explicit XAudio2Backend(int buffers = 4);
+
+    bool open(Mixer& mixer) override;
+    void close() override;
+    const char* name() const override { return "XAudio2"; }
+    unsigned long long xruns() const override { return starved; }
+    uint64_t queuedFrames() const override;
+
+private:
+    void submitNext();
+
+    void STDMETHODCALLTYPE OnVoiceProcessingPassStart(UINT32) override {}
+    void STDMETHODCALLTYPE OnVoiceProcessingPassEnd() override {}
+    void STDMETHODCALLTYPE OnStreamEnd() override {}
+    void STDMETHODCALLTYPE OnBufferStart(void*) override {}
+    void STDMETHODCALLTYPE OnBufferEnd(void*) override { submitNext(); }
+    void STDMETHODCALLTYPE OnLoopEnd(void*) override {}
+    void STDMETHODCALLTYPE OnVoiceError(void*, HRESULT) override {}
+
+    IXAudio2* xaudio = nullptr;
+    IXAudio2MasteringVoice* masterVoice = nullptr;
+    IXAudio2SourceVoice* sourceVoice = nullptr;
+
+    Mixer* mixer = nullptr;
+    std::vector<std::vector<float>> buffers;
+    int nextBuffer = 0;
+    std::atomic<uint64_t> framesSubmitted{ 0 };
+    std::atomic<bool> running{ false };
+    std::atomic<unsigned long long> starved{ 0 };
+};